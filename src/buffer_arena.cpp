@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "buffer_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+ArenaBuffer::~ArenaBuffer() {
+    if (!data_) return;
+    if (arena_) {
+        arena_->release(*this);
+    } else {
+        BufferArena::deallocate(data_);
+    }
+}
+
+BufferArena::BufferArena(size_t maxIdleBytes) : maxIdleBytes_(maxIdleBytes), idleBytes_(0), generation_(0) {}
+
+size_t BufferArena::roundedCapacity(size_t bytes) {
+    // small buffers to 64 kB, so that windows differing by a few pixels still share buffers
+    size_t granularity = bytes >= kHugePageSize / 2 ? kHugePageSize : size_t(64) << 10;
+    return (std::max(bytes, size_t(1)) + granularity - 1) / granularity * granularity;
+}
+
+void *BufferArena::allocate(size_t capacity) {
+    size_t alignment = capacity >= kHugePageSize ? kHugePageSize : kAlignment;
+    void *data = nullptr;
+#ifdef _WIN32
+    data = _aligned_malloc(capacity, alignment);
+#else
+    if (posix_memalign(&data, alignment, capacity) != 0) {
+        data = nullptr;
+    }
+#endif
+    if (!data) {
+        throw std::bad_alloc();
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (capacity >= kHugePageSize) {
+        // only a hint, it's fine if transparent huge pages are off
+        madvise(data, capacity, MADV_HUGEPAGE);
+    }
+#endif
+    return data;
+}
+
+void BufferArena::deallocate(void *data) {
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+ArenaBuffer BufferArena::acquire(BufferArena *arena, size_t bytes) {
+    ArenaBuffer buffer;
+    buffer.size_ = bytes;
+    buffer.capacity_ = roundedCapacity(bytes);
+    buffer.arena_ = arena;
+
+    if (arena) {
+        std::lock_guard<std::mutex> lock(arena->mutex_);
+        buffer.generation_ = arena->generation_;
+
+        // smallest idle buffer that fits, unless it's so much bigger that it's better kept for a bigger request
+        auto it = arena->idle_.lower_bound(buffer.capacity_);
+        if (it != arena->idle_.end() && it->first <= buffer.capacity_ + buffer.capacity_ / 4) {
+            buffer.capacity_ = it->first;
+            buffer.data_ = it->second;
+            arena->idleBytes_ -= it->first;
+            arena->idle_.erase(it);
+            return buffer;
+        }
+    }
+
+    buffer.data_ = allocate(buffer.capacity_);
+    return buffer;
+}
+
+void BufferArena::release(ArenaBuffer &buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer.generation_ == generation_ && idleBytes_ + buffer.capacity_ <= maxIdleBytes_) {
+            idle_.emplace(buffer.capacity_, buffer.data_);
+            idleBytes_ += buffer.capacity_;
+            buffer.data_ = nullptr;
+            return;
+        }
+    }
+    deallocate(buffer.data_);
+    buffer.data_ = nullptr;
+}
+
+void BufferArena::purge() {
+    std::multimap<size_t, void *> idle;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle.swap(idle_);
+        idleBytes_ = 0;
+        generation_++;
+    }
+    for (const auto &entry: idle) {
+        deallocate(entry.second);
+    }
+}
+
+size_t BufferArena::idleBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idleBytes_;
+}
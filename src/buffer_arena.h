@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+
+class BufferArena;
+
+// Uninitialized aligned memory, handed back to its arena (or freed, without one) when destroyed
+class ArenaBuffer {
+public:
+    ArenaBuffer() : data_(nullptr), size_(0), capacity_(0), generation_(0), arena_(nullptr) {}
+
+    ArenaBuffer(ArenaBuffer &&other) noexcept : ArenaBuffer() { swap(other); }
+
+    ArenaBuffer &operator=(ArenaBuffer &&other) noexcept {
+        ArenaBuffer(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ArenaBuffer(const ArenaBuffer &) = delete;
+
+    ArenaBuffer &operator=(const ArenaBuffer &) = delete;
+
+    ~ArenaBuffer();
+
+    template<typename T = void>
+    T *data() const { return (T *) data_; }
+
+    // bytes asked for, capacity() may be bigger
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return capacity_; }
+
+    void swap(ArenaBuffer &other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(generation_, other.generation_);
+        std::swap(arena_, other.arena_);
+    }
+
+private:
+    friend class BufferArena;
+
+    void *data_;
+    size_t size_, capacity_;
+    uint64_t generation_;
+    BufferArena *arena_;
+};
+
+// Pool of big scratch buffers (packed vectors, noise copies, tile accumulators...) reused across renders,
+// so that a render of the same size as the last one doesn't allocate, nor page fault its memory in again.
+//
+// Buffers are cache line aligned; big ones are also aligned and rounded to 2 MB, so that the kernel can back them
+// with huge pages (on Linux they are madvise()d to). A released buffer is kept idle for the next acquire() of a
+// similar size, as long as the idle ones stay under maxIdleBytes. Thread safe; buffers must not outlive the arena.
+class BufferArena {
+public:
+    static const size_t kAlignment = 64;
+    static const size_t kHugePageSize = size_t(2) << 20;
+    static const size_t kDefaultMaxIdleBytes = size_t(2) << 30;
+
+    explicit BufferArena(size_t maxIdleBytes = kDefaultMaxIdleBytes);
+
+    ~BufferArena() { purge(); }
+
+    // arena may be nullptr, then the buffer is simply freed when destroyed
+    static ArenaBuffer acquire(BufferArena *arena, size_t bytes);
+
+    ArenaBuffer acquire(size_t bytes) { return acquire(this, bytes); }
+
+    // Frees the idle buffers; buffers in use are freed instead of kept when they come back
+    void purge();
+
+    size_t idleBytes() const;
+
+private:
+    friend class ArenaBuffer;
+
+    void release(ArenaBuffer &buffer);
+
+    static size_t roundedCapacity(size_t bytes);
+
+    static void *allocate(size_t capacity);
+
+    static void deallocate(void *data);
+
+    size_t maxIdleBytes_;
+    mutable std::mutex mutex_;
+    // idle buffers by capacity
+    std::multimap<size_t, void *> idle_;
+    size_t idleBytes_;
+    // bumped by purge()
+    uint64_t generation_;
+};
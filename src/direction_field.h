@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "buffer_arena.h"
+#include "rect.h"
+
+// Unit vector directions packed into one interleaved (x, y) float buffer, plus validity bitmask.
+//
+// The buffer covers the render window plus a border wide enough for any streamline starting in the window
+// (and the extra bilinear tap), so lookups are plain pointer arithmetic with no clamping. Pixels in the border which are outside
+// of the source images hold the clamped edge values.
+//
+// It's filled once per frame: put raw vectors into row(), then call normalizeRow() on it. Pixels where the vector
+// is null or NaN are marked invalid in the bitmask and their direction is set to zero. The memory comes from
+// the arena passed to reset(), if any, so that consecutive frames reuse it.
+class DirectionField {
+public:
+    DirectionField() : bounds_{0, 0, 0, 0}, wordsPerRow_(0), dataSize_(0) {}
+
+    // contents are undefined until the rows are filled and normalized
+    void reset(const RectI &bounds, BufferArena *arena = nullptr) {
+        bounds_ = bounds;
+        wordsPerRow_ = (bounds.width() + 63) / 64;
+        dataSize_ = 2 * (size_t) bounds.width() * (size_t) bounds.height();
+        // release first, so that the arena can hand the same buffers back
+        data_ = ArenaBuffer();
+        valid_ = ArenaBuffer();
+        data_ = BufferArena::acquire(arena, dataSize_ * sizeof(float));
+        valid_ = BufferArena::acquire(arena, (size_t) wordsPerRow_ * (size_t) bounds.height() * sizeof(uint64_t));
+    }
+
+    const RectI &bounds() const { return bounds_; }
+
+    float *row(int y) {
+        return data_.data<float>() + 2 * (size_t) (y - bounds_.y1) * (size_t) bounds_.width();
+    }
+
+    void normalizeRow(int y) {
+        float *v = row(y);
+        uint64_t *bits = valid_.data<uint64_t>() + (size_t) (y - bounds_.y1) * wordsPerRow_;
+        std::fill(bits, bits + wordsPerRow_, 0);
+
+        for (int i = 0; i < bounds_.width(); i++) {
+            float ux = v[2 * i], uy = v[2 * i + 1];
+            float umag = sqrtf(ux * ux + uy * uy);
+            ux /= umag;
+            uy /= umag;
+
+            if (std::isfinite(ux) && std::isfinite(uy) && (ux != 0 || uy != 0)) {
+                bits[i >> 6] |= uint64_t(1) << (i & 63);
+            } else {
+                ux = uy = 0.0f;
+            }
+            v[2 * i] = ux;
+            v[2 * i + 1] = uy;
+        }
+    }
+
+    // (x, y) must be inside bounds()
+    inline bool isValid(int x, int y) const {
+        int i = x - bounds_.x1;
+        return (valid_.data<const uint64_t>()[(size_t) (y - bounds_.y1) * wordsPerRow_ + (i >> 6)] >> (i & 63)) & 1;
+    }
+
+    // Whether any pixel of the region (which must be inside bounds()) is valid
+    bool anyValid(const RectI &region) const {
+        int i1 = region.x1 - bounds_.x1, i2 = region.x2 - bounds_.x1;
+        for (int y = region.y1; y < region.y2; y++) {
+            const uint64_t *bits = valid_.data<uint64_t>() + (size_t) (y - bounds_.y1) * wordsPerRow_;
+            for (int w = i1 >> 6; w <= (i2 - 1) >> 6; w++) {
+                uint64_t mask = ~uint64_t(0);
+                if (w == i1 >> 6) mask &= ~uint64_t(0) << (i1 & 63);
+                if (w == (i2 - 1) >> 6) mask &= ~uint64_t(0) >> (63 - ((i2 - 1) & 63));
+                if (bits[w] & mask) return true;
+            }
+        }
+        return false;
+    }
+
+    // (x, y) must be inside bounds()
+    inline const float *at(int x, int y) const {
+        return data_.data<const float>() + 2 * ((size_t) (y - bounds_.y1) * (size_t) bounds_.width() + (size_t) (x - bounds_.x1));
+    }
+
+    // Bilinearly interpolated direction at (x, y), renormalized to unit length; invalid taps have zero direction
+    // so they just don't contribute. Validity is that of the truncated pixel, as with at() - so streamlines stop
+    // at the same places with either lookup. (x, y) and (x + 1, y + 1) must be inside bounds().
+    inline bool sampleBilinear(float x, float y, float &ux, float &uy) const {
+        int ix = (int) x, iy = (int) y;
+        float fx = std::floor(x), fy = std::floor(y);
+        float ax = x - fx, ay = y - fy;
+        const float *u = at(ix, iy);
+        ux = u[0];
+        uy = u[1];
+        if (!isValid(ix, iy) || (ax == 0.0f && ay == 0.0f)) {
+            // integer positions (the start of each streamline) need no interpolation
+            return isValid(ix, iy);
+        }
+
+        const float *t = at((int) fx, (int) fy);
+        const size_t stride = 2 * (size_t) bounds_.width();
+        float topX = t[0] + ax * (t[2] - t[0]);
+        float topY = t[1] + ax * (t[3] - t[1]);
+        float bottomX = t[stride] + ax * (t[stride + 2] - t[stride]);
+        float bottomY = t[stride + 1] + ax * (t[stride + 3] - t[stride + 1]);
+        float vx = topX + ay * (bottomX - topX);
+        float vy = topY + ay * (bottomY - topY);
+
+        // opposite directions may cancel out, keep the nearest one then
+        float vmag = sqrtf(vx * vx + vy * vy);
+        if (vmag > 0.0f) {
+            ux = vx / vmag;
+            uy = vy / vmag;
+        }
+        return true;
+    }
+
+    // Hash of the bounds and directions, to recognize the same field in a later render
+    uint64_t hash() const {
+        // FNV-1a over 64-bit words
+        const uint64_t prime = 0x100000001b3ULL;
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (int v: {bounds_.x1, bounds_.y1, bounds_.x2, bounds_.y2}) {
+            h = (h ^ (uint32_t) v) * prime;
+        }
+        const float *data = data_.data<const float>();
+        for (size_t i = 0; i + 1 < dataSize_; i += 2) {
+            uint64_t w;
+            std::memcpy(&w, &data[i], sizeof(w));
+            h = (h ^ w) * prime;
+        }
+        return h;
+    }
+
+private:
+    RectI bounds_;
+    int wordsPerRow_;
+    size_t dataSize_;
+    ArenaBuffer data_;
+    ArenaBuffer valid_;
+};
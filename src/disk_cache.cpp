@@ -0,0 +1,279 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "disk_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+static const char *kEntrySuffix = ".lic";
+
+namespace {
+
+// bump when the layout of entry files changes
+const uint32_t kEntryVersion = 1;
+const char kEntryMagic[4] = {'L', 'I', 'C', 'C'};
+
+// Start of every entry file, followed by the key bytes (padded to 8 bytes) and the pixels
+struct EntryHeader {
+    char magic[4];
+    uint32_t version;
+    DiskCacheFormat format;
+    uint64_t keySize;
+    uint64_t dataSize;
+};
+
+size_t paddedKeySize(const HashBuilder &key) {
+    return (key.bytes().size() + 7) & ~(size_t) 7;
+}
+
+size_t entrySize(const HashBuilder &key, size_t dataSize) {
+    return sizeof(EntryHeader) + paddedKeySize(key) + dataSize;
+}
+
+bool isEntryOf(const void *file, const HashBuilder &key, const DiskCacheFormat &format, size_t dataSize) {
+    EntryHeader header;
+    std::memcpy(&header, file, sizeof(header));
+    return std::memcmp(header.magic, kEntryMagic, sizeof(kEntryMagic)) == 0 && header.version == kEntryVersion &&
+           header.format == format && header.keySize == key.bytes().size() && header.dataSize == dataSize &&
+           std::memcmp((const char *) file + sizeof(header), key.bytes().data(), key.bytes().size()) == 0;
+}
+
+// Bumps the modification time, that's what eviction goes by
+void touch(const std::string &path) {
+#ifdef _WIN32
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    HANDLE wh = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (wh != INVALID_HANDLE_VALUE) {
+        SetFileTime(wh, nullptr, nullptr, &now);
+        CloseHandle(wh);
+    }
+#else
+    utime(path.c_str(), nullptr);
+#endif
+}
+
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (handle_) CloseHandle(handle_);
+#else
+    if (data_) munmap(const_cast<void *>(data_), size_);
+#endif
+}
+
+DiskCache *DiskCache::instance() {
+    static DiskCache *cache = []() -> DiskCache * {
+        const char *dir = std::getenv("LIC_DISK_CACHE_DIR");
+        if (!dir || !*dir) return nullptr;
+
+        uint64_t maxMB = 10240;
+        if (const char *s = std::getenv("LIC_DISK_CACHE_MAX_MB")) {
+            maxMB = std::strtoull(s, nullptr, 10);
+        }
+#ifdef _WIN32
+        _mkdir(dir);
+#else
+        mkdir(dir, 0777);
+#endif
+        return new DiskCache(dir, maxMB << 20);
+    }();
+    return cache;
+}
+
+std::string DiskCache::path(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx%s", (unsigned long long) key, kEntrySuffix);
+    return directory_ + name;
+}
+
+std::unique_ptr<MappedFile> DiskCache::find(const HashBuilder &key, const DiskCacheFormat &format, size_t size) {
+    std::string p = path(key.hash());
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    // a file of other size is truncated or something else, no need to map it
+    size_t fileSize = entrySize(key, size);
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(p.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER actualSize;
+    if (GetFileSizeEx(fh, &actualSize) && (uint64_t) actualSize.QuadPart == fileSize) {
+        file->handle_ = CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (file->handle_) file->data_ = MapViewOfFile(file->handle_, FILE_MAP_READ, 0, 0, 0);
+    }
+    CloseHandle(fh);
+#else
+    int fd = open(p.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (uint64_t) st.st_size == fileSize) {
+        void *data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) file->data_ = data;
+    }
+    close(fd);
+#endif
+
+    if (!file->data_) return nullptr;
+    file->size_ = fileSize;
+    if (!isEntryOf(file->data_, key, format, size)) return nullptr;
+    file->offset_ = fileSize - size;
+    touch(p);
+    return file;
+}
+
+void DiskCache::store(const HashBuilder &key, const DiskCacheFormat &format, const void *data, size_t size) {
+    static std::atomic<unsigned> counter(0);
+    std::string p = path(key.hash());
+    char suffix[64];
+#ifdef _WIN32
+    snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", _getpid(), counter++);
+#else
+    snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int) getpid(), counter++);
+#endif
+    std::string tmp = p + suffix;
+
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "DiskCache: cannot write %s\n", tmp.c_str());
+        return;
+    }
+    EntryHeader header = {};
+    std::memcpy(header.magic, kEntryMagic, sizeof(kEntryMagic));
+    header.version = kEntryVersion;
+    header.format = format;
+    header.keySize = key.bytes().size();
+    header.dataSize = size;
+    std::string paddedKey = key.bytes();
+    paddedKey.resize(paddedKeySize(key), '\0');
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(paddedKey.data(), 1, paddedKey.size(), f) == paddedKey.size() &&
+              fwrite(data, 1, size, f) == size;
+    ok = fclose(f) == 0 && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp.c_str(), p.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp.c_str(), p.c_str()) == 0;
+#endif
+    if (!ok) {
+        fprintf(stderr, "DiskCache: cannot write %s\n", p.c_str());
+        remove(tmp.c_str());
+        return;
+    }
+
+    evict(entrySize(key, size));
+}
+
+namespace {
+
+struct Entry {
+    std::string path;
+    uint64_t size;
+    int64_t mtime;
+};
+
+std::vector<Entry> listEntries(const std::string &directory) {
+    std::vector<Entry> entries;
+    size_t suffixLength = std::string(kEntrySuffix).size();
+    auto isEntry = [suffixLength](const std::string &name) {
+        return name.size() > suffixLength && name.compare(name.size() - suffixLength, suffixLength, kEntrySuffix) == 0;
+    };
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((directory + "/*" + kEntrySuffix).c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) return entries;
+    do {
+        std::string name = fd.cFileName;
+        if (!isEntry(name)) continue;
+        uint64_t size = ((uint64_t) fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+        int64_t mtime = (int64_t) (((uint64_t) fd.ftLastWriteTime.dwHighDateTime << 32) |
+                                   fd.ftLastWriteTime.dwLowDateTime);
+        entries.push_back({directory + "/" + name, size, mtime});
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR *dir = opendir(directory.c_str());
+    if (!dir) return entries;
+    while (struct dirent *de = readdir(dir)) {
+        std::string name = de->d_name;
+        if (!isEntry(name)) continue;
+        std::string p = directory + "/" + name;
+        struct stat st;
+        if (stat(p.c_str(), &st) == 0) {
+            entries.push_back({p, (uint64_t) st.st_size, (int64_t) st.st_mtime});
+        }
+    }
+    closedir(dir);
+#endif
+
+    return entries;
+}
+
+}
+
+void DiskCache::evict(uint64_t storedBytes) {
+    std::lock_guard<std::mutex> lock(evictMutex_);
+
+    estimatedBytes_ += storedBytes;
+    if (scanned_ && estimatedBytes_ <= maxBytes_) return;
+    scanned_ = true;
+
+    std::vector<Entry> entries = listEntries(directory_);
+    uint64_t total = 0;
+    for (const auto &e: entries) total += e.size;
+
+    if (total > maxBytes_) {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.mtime < b.mtime; });
+        for (const auto &e: entries) {
+            if (total <= maxBytes_) break;
+            // may fail when another process has it mapped on Windows, it'll go next time
+            if (remove(e.path.c_str()) == 0) {
+                total -= e.size;
+            }
+        }
+    }
+    estimatedBytes_ = total;
+}
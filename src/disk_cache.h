@@ -0,0 +1,128 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// FNV-1a, for building cache keys out of everything a result depends on - keeps the bytes too, so that
+// entries can be told apart when their hashes collide
+class HashBuilder {
+public:
+    HashBuilder() : h_(0xcbf29ce484222325ULL) {}
+
+    HashBuilder &addBytes(const void *data, size_t size) {
+        auto bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; i++) {
+            h_ = (h_ ^ bytes[i]) * 0x100000001b3ULL;
+        }
+        bytes_.append((const char *) data, size);
+        return *this;
+    }
+
+    template<typename T>
+    HashBuilder &add(const T &value) { return addBytes(&value, sizeof(value)); }
+
+    uint64_t hash() const { return h_; }
+
+    const std::string &bytes() const { return bytes_; }
+
+private:
+    uint64_t h_;
+    std::string bytes_;
+};
+
+// Layout of the pixels of a cache entry, checked on lookup along with the key
+struct DiskCacheFormat {
+    int32_t width, height;
+    int32_t components;
+    int32_t bytesPerComponent;
+
+    bool operator==(const DiskCacheFormat &o) const {
+        return width == o.width && height == o.height && components == o.components &&
+               bytesPerComponent == o.bytesPerComponent;
+    }
+};
+
+// Read-only memory mapping of a cache entry
+class MappedFile {
+public:
+    ~MappedFile();
+
+    // the pixels, after the header
+    const void *data() const { return (const char *) data_ + offset_; }
+
+    size_t size() const { return size_ - offset_; }
+
+private:
+    friend class DiskCache;
+    MappedFile() : data_(nullptr), size_(0), offset_(0), handle_(nullptr) {}
+
+    // the whole file
+    const void *data_;
+    size_t size_;
+    size_t offset_;
+    void *handle_; // file mapping handle on Windows
+};
+
+// Finished renders kept on disk, shared by all instances and processes using the same directory - for farms
+// re-rendering the same shots. One file per entry, named by the hash of its key, with a header holding the whole
+// key, the file layout version and the pixel format - files that don't match all of them (other builds,
+// hash collisions, truncated files) are not used. Least recently used entries (by file modification time,
+// which is bumped on every hit) are evicted once the directory grows over the size cap.
+//
+// Configured from the environment: LIC_DISK_CACHE_DIR enables the cache, LIC_DISK_CACHE_MAX_MB is the size cap
+// (10 GB by default).
+class DiskCache {
+public:
+    // nullptr when the cache is not enabled
+    static DiskCache *instance();
+
+    // Maps the entry, or returns nullptr if there is none with this key, format and size
+    std::unique_ptr<MappedFile> find(const HashBuilder &key, const DiskCacheFormat &format, size_t size);
+
+    // Writes the entry (atomically, so that other processes never see a partial one) and evicts old entries
+    // if the directory has grown over the size cap
+    void store(const HashBuilder &key, const DiskCacheFormat &format, const void *data, size_t size);
+
+private:
+    DiskCache(std::string directory, uint64_t maxBytes)
+            : directory_(std::move(directory)), maxBytes_(maxBytes), estimatedBytes_(0), scanned_(false) {}
+
+    std::string path(uint64_t key) const;
+
+    // Adds a stored entry to the size estimate; once that goes over the cap (or on the first store), scans
+    // the directory and evicts - entries of other processes are only counted then
+    void evict(uint64_t storedBytes);
+
+    std::string directory_;
+    uint64_t maxBytes_;
+    // eviction scans the directory, one at a time is enough
+    std::mutex evictMutex_;
+    uint64_t estimatedBytes_;
+    bool scanned_;
+};
@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "buffer_arena.h"
+#include "direction_field.h"
+#include "noise_texture.h"
+#include "rect.h"
+
+// Coarser levels of a DirectionField and its baked noise, for multi-scale LIC: far from the seed, streamlines
+// take steps of 2^level pixels on level `level`, with directions and noise averaged over blocks of
+// 2^level x 2^level pixels. Long streamlines then need a fraction of the lookups, from a working set that
+// shrinks 4x per level.
+//
+// Pixel (i, j) of a level is the block of pixels [2i, 2i + 2) x [2j, 2j + 2) of the level below it, level 0 being
+// the field and the noise texture themselves (not stored here). Its direction is the renormalized mean of
+// the valid directions of the block (the block is valid if any of them is), its noise the mean of the noise.
+//
+// Usage: reset(), then buildRows() for all rows of each level in turn. Rows of one level only read the level
+// below, so they can be built from several threads.
+class FieldPyramid {
+public:
+    static const int kMaxLevels = 3;
+
+    FieldPyramid() : field_(nullptr), noise_(nullptr), numLevels_(0) {}
+
+    // noise must be prepared for all of the field's bounds
+    void reset(const DirectionField &field, const NoiseTexture &noise, int numLevels, BufferArena *arena = nullptr) {
+        field_ = &field;
+        noise_ = &noise;
+        numLevels_ = std::min(numLevels, kMaxLevels);
+
+        const RectI &fb = field.bounds();
+        for (int level = 1; level <= numLevels_; level++) {
+            Level &l = levels_[level - 1];
+            l.bounds = {fb.x1 >> level, fb.y1 >> level, ((fb.x2 - 1) >> level) + 1, ((fb.y2 - 1) >> level) + 1};
+            size_t pixels = (size_t) l.bounds.width() * l.bounds.height();
+            // release first, so that the arena can hand the same buffers back
+            l.directions = ArenaBuffer();
+            l.valid = ArenaBuffer();
+            l.noise = ArenaBuffer();
+            l.directions = BufferArena::acquire(arena, 2 * pixels * sizeof(float));
+            l.valid = BufferArena::acquire(arena, pixels);
+            l.noise = BufferArena::acquire(arena, pixels * sizeof(float));
+        }
+    }
+
+    int numLevels() const { return numLevels_; }
+
+    // in pixels of the level
+    const RectI &bounds(int level) const { return levels_[level - 1].bounds; }
+
+    // Fills rows [y1, y2) (in pixels of the level) of level 1..numLevels(), the level below must be complete
+    void buildRows(int level, int y1, int y2) {
+        Level &l = levels_[level - 1];
+        const RectI &b = l.bounds;
+        const RectI &sb = level == 1 ? field_->bounds() : levels_[level - 2].bounds;
+
+        for (int j = y1; j < y2; j++) {
+            for (int i = b.x1; i < b.x2; i++) {
+                float sumX = 0.0f, sumY = 0.0f, sumNoise = 0.0f;
+                int valid = 0, texels = 0;
+                for (int y = std::max(2 * j, sb.y1); y < std::min(2 * j + 2, sb.y2); y++) {
+                    for (int x = std::max(2 * i, sb.x1); x < std::min(2 * i + 2, sb.x2); x++) {
+                        float ux, uy;
+                        bool v = level == 1 ? sourceField(x, y, ux, uy) : sourceLevel(level - 1, x, y, ux, uy);
+                        sumNoise += level == 1 ? noise_->texel(x, y) : levels_[level - 2].noiseAt(x, y);
+                        texels++;
+                        if (v) {
+                            sumX += ux;
+                            sumY += uy;
+                            valid++;
+                        }
+                    }
+                }
+
+                size_t idx = l.index(i, j);
+                float mag = std::sqrt(sumX * sumX + sumY * sumY);
+                bool v = valid > 0 && mag > 0.0f;
+                l.directions.data<float>()[2 * idx] = v ? sumX / mag : 0.0f;
+                l.directions.data<float>()[2 * idx + 1] = v ? sumY / mag : 0.0f;
+                l.valid.data<uint8_t>()[idx] = v;
+                l.noise.data<float>()[idx] = texels > 0 ? sumNoise / (float) texels : 0.5f;
+            }
+        }
+    }
+
+    // Direction of the block containing (x, y) (in level 0 pixels), clamped to the edge of the level
+    inline bool sampleDirection(int level, float x, float y, float &ux, float &uy) const {
+        const Level &l = levels_[level - 1];
+        size_t idx = l.clampedIndex((int) std::floor(x) >> level, (int) std::floor(y) >> level);
+        ux = l.directions.data<const float>()[2 * idx];
+        uy = l.directions.data<const float>()[2 * idx + 1];
+        return l.valid.data<const uint8_t>()[idx] != 0;
+    }
+
+    // Bilinearly interpolated block noise at (x, y) (in level 0 pixels), clamped to the edge of the level
+    inline float sampleNoise(int level, float x, float y) const {
+        const Level &l = levels_[level - 1];
+        // block i is centered at level 0 pixel position (i + 0.5) * 2^level - 0.5
+        float scale = 1.0f / (float) (1 << level);
+        float cx = (x + 0.5f) * scale - 0.5f, cy = (y + 0.5f) * scale - 0.5f;
+        float fx = std::floor(cx), fy = std::floor(cy);
+        int ix = (int) fx, iy = (int) fy;
+        float ax = cx - fx, ay = cy - fy;
+
+        const RectI &b = l.bounds;
+        int i0 = std::min(std::max(ix, b.x1), b.x2 - 1) - b.x1, i1 = std::min(std::max(ix + 1, b.x1), b.x2 - 1) - b.x1;
+        int j0 = std::min(std::max(iy, b.y1), b.y2 - 1) - b.y1, j1 = std::min(std::max(iy + 1, b.y1), b.y2 - 1) - b.y1;
+        const float *top = l.noise.data<const float>() + (size_t) j0 * b.width();
+        const float *bottom = l.noise.data<const float>() + (size_t) j1 * b.width();
+        float t = top[i0] + ax * (top[i1] - top[i0]);
+        float u = bottom[i0] + ax * (bottom[i1] - bottom[i0]);
+        return t + ay * (u - t);
+    }
+
+private:
+    struct Level {
+        RectI bounds;
+        ArenaBuffer directions;
+        ArenaBuffer valid;
+        ArenaBuffer noise;
+
+        size_t index(int i, int j) const {
+            return (size_t) (j - bounds.y1) * bounds.width() + (i - bounds.x1);
+        }
+
+        size_t clampedIndex(int i, int j) const {
+            return index(std::min(std::max(i, bounds.x1), bounds.x2 - 1),
+                         std::min(std::max(j, bounds.y1), bounds.y2 - 1));
+        }
+
+        float noiseAt(int i, int j) const {
+            return noise.data<const float>()[index(i, j)];
+        }
+    };
+
+    bool sourceField(int x, int y, float &ux, float &uy) const {
+        const float *u = field_->at(x, y);
+        ux = u[0];
+        uy = u[1];
+        return field_->isValid(x, y);
+    }
+
+    bool sourceLevel(int level, int i, int j, float &ux, float &uy) const {
+        const Level &l = levels_[level - 1];
+        size_t idx = l.index(i, j);
+        ux = l.directions.data<const float>()[2 * idx];
+        uy = l.directions.data<const float>()[2 * idx + 1];
+        return l.valid.data<const uint8_t>()[idx] != 0;
+    }
+
+    const DirectionField *field_;
+    const NoiseTexture *noise_;
+    int numLevels_;
+    Level levels_[kMaxLevels];
+};
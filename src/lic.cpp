@@ -24,12 +24,34 @@ THE SOFTWARE.
 #include <windows.h>
 #endif
 
+#include <array>
+#include <chrono>
 #include <cstdio>
-#include <random>
+#include <memory>
+#include <cstring>
 #include "ofxsImageEffect.h"
 #include "ofxsMultiThread.h"
-#include "SimplexNoise.h"
+#include "noise_function.h"
 #include "ofxsProcessing.H"
+#include "buffer_arena.h"
+#include "noise_texture.h"
+#include "direction_field.h"
+#include "half_float.h"
+#include "lic_simd.h"
+#include "lic_opencl.h"
+#include "tile_scheduler.h"
+#include "streamline_cache.h"
+#include "disk_cache.h"
+#include "lic_core.h"
+#include "render_stats.h"
+#include "temporal.h"
+
+#ifdef LIC_HAVE_OPENCL
+#include "ofxGPURender.h"
+#endif
+
+// bump when a change makes renders come out different, so that stale disk cache entries are not picked up
+static const int kDiskCacheVersion = 1;
 
 template<typename T>
 static inline T clamp(T value, T lower, T upper) {
@@ -41,6 +63,23 @@ static inline T clamp(T value, T lower, T upper) {
     return value;
 }
 
+static inline int component_count(OFX::PixelComponentEnum components) {
+    switch (components) {
+        case OFX::ePixelComponentRGBA: return 4;
+        case OFX::ePixelComponentRGB: return 3;
+        default: return 1;
+    }
+}
+
+// The image for the lic_core helpers (to_float(), store_pixel(), pack_vector_row(), ...), PIX is float or
+// uint16_t for half float
+template<typename PIX>
+static LICImageT<const PIX> lic_image(const OFX::Image &img) {
+    OfxRectI b = img.getBounds();
+    return {(const PIX *) img.getPixelData(), RectI{b.x1, b.y1, b.x2, b.y2}, component_count(img.getPixelComponents()),
+            img.getRowBytes() / (ptrdiff_t) sizeof(PIX)};
+}
+
 template<typename T>
 static inline bool is_one_of(T value, std::initializer_list<T> choices) {
     for (const auto &x: choices) {
@@ -49,317 +88,1488 @@ static inline bool is_one_of(T value, std::initializer_list<T> choices) {
     return false;
 }
 
-// Base class for the RGBA and the Alpha processor
-class LICProcessor : public OFX::ImageProcessor {
+// Base class for the LIC processors - the integrator with its parameters, inputs and sampling (see lic_core.h)
+// running on the host's threads
+class LICProcessorBase : public OFX::ImageProcessor, public LICIntegrator {
 protected :
-    OFX::Image *vectorXImg_;
-    OFX::Image *vectorYImg_;
-    SimplexNoise noise;
-    float frequency;
-    int num_steps;
-    bool use_weight_window;
-    int weight_window_width;
-    int weight_window_offset;
-    double _debug_time;
+    // hands out tiles of the render window to the threads, instead of one horizontal strip per thread
+    TileScheduler scheduler_;
+
+    // > 1 for interactive previews that integrate one pixel per block of previewStride_ x previewStride_,
+    // only LICProcessor does that
+    int previewStride_;
+
+    // per thread counters, nullptr unless instrumentation is on (see render_stats.h)
+    RenderStats *stats_;
+
+    // where scratch buffers come from, nullptr to just allocate them
+    BufferArena *arena_;
+
+    // colour LIC multiplies the texture by the noise, otherwise it's smeared as it is (see texture_mode)
+    bool modulateTexture_;
+
+    virtual int tileSize() const { return defaultTileSize(); }
 
-    inline float sampleRandomData(float x, float y) {
-        return 0.5 + 0.5 * noise.noise(frequency * x, frequency * y);
+    // processes one tile of the render window, adding the work done to counts if it's not nullptr
+    virtual void processTile(const OfxRectI &procWindow, LICStepCounts *counts) = 0;
+
+public :
+    explicit LICProcessorBase(OFX::ImageEffect &instance)
+            : OFX::ImageProcessor(instance), previewStride_(1), stats_(nullptr), arena_(nullptr),
+              modulateTexture_(true) {
     }
 
-    inline float sampleImageData(OFX::Image *img, float x, float y) {
-        int x_ = int(x);
-        int y_ = int(y);
-        auto bounds = img->getBounds();
+    // for the instrumentation
+    virtual const char *name() const = 0;
+
+    void setStats(RenderStats *stats) { stats_ = stats; }
+
+    void setBufferArena(BufferArena *arena) { arena_ = arena; }
+
+    void setPreviewStride(int d) { previewStride_ = d; }
+
+    void setModulateTexture(bool v) { modulateTexture_ = v; }
 
-        x_ = clamp(x_, bounds.x1, bounds.x2 - 1);
-        y_ = clamp(y_, bounds.y1, bounds.y2 - 1);
+    int previewStride() const { return previewStride_; }
 
-        return *(float *) img->getPixelAddress(x_, y_);
+    // processors that can only sample noise from the baked texture
+    virtual bool requiresNoiseTexture() const { return false; }
+
+    void preProcess() override {
+        prepareWeights();
+
+        const OfxRectI &rw = _renderWindow;
+        scheduler_.reset(RectI{rw.x1, rw.y1, rw.x2, rw.y2}, tileSize(), OFX::MultiThread::getNumCPUs());
     }
 
-    inline float getStepWeight(int signedIdx) const {
-        if (!use_weight_window) {
-            return 1.0f;
-        } else {
-            int N = 2*num_steps;
-            int idx = (signedIdx + num_steps) % (N + 1);
-            int offsetIdx = (weight_window_offset + num_steps) % N;
-            int offsetIdx2 = ((weight_window_offset + num_steps) % N) + N;
-            int dist = std::min(std::abs(idx - offsetIdx), std::abs(idx - offsetIdx2));
-
-            if (dist > weight_window_width) {
-                return 0.0f;
-            } else {
-                return 1.0f - (float)dist/(float)weight_window_width;
+    void multiThreadFunction(unsigned int threadIndex, unsigned int /*threadMax*/) override {
+        LICThreadStats *threadStats = stats_ && threadIndex < stats_->numThreads() ? &stats_->thread(threadIndex)
+                                                                                   : nullptr;
+        auto start = std::chrono::steady_clock::now();
+
+        RectI tile;
+        while (scheduler_.next(threadIndex, tile)) {
+            if (_effect.abort()) {
+                if (stats_) stats_->noteAbort();
+                break;
             }
+            processTile(OfxRectI{tile.x1, tile.y1, tile.x2, tile.y2}, threadStats ? &threadStats->counts : nullptr);
+            if (threadStats) {
+                threadStats->tiles++;
+                threadStats->pixels += (uint64_t) tile.width() * tile.height();
+            }
+        }
+
+        if (threadStats) {
+            threadStats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
         }
     }
 
-public :
-    explicit LICProcessor(OFX::ImageEffect &instance)
-            : OFX::ImageProcessor(instance), vectorXImg_(nullptr), vectorYImg_(nullptr), frequency(1), num_steps(15),
-              use_weight_window(false), weight_window_width(10), weight_window_offset(0) {
+    void multiThreadProcessImages(OfxRectI procWindow) override {
+        processTile(procWindow, nullptr);
     }
+};
 
-    void setVectorXImg(OFX::Image *v) { vectorXImg_ = v; }
+// The reference LIC processor, one streamline per pixel integrated by LICIntegrator::integratePixel()
+//
+// Weighting and output pixel type (float or uint16_t for half float, RGBA or Alpha) are template parameters,
+// so that the inner loop has no branches for them; use LICPlugin::render to pick the right instantiation.
+template<bool UseWeightWindow, typename PIX, int Components>
+class LICProcessor : public LICProcessorBase {
+protected :
+    // one output pixel - the LIC value, or the integrated texture when there is one
+    inline void integrateAndStore(int x, int y, PIX *dstPix, LICStepCounts *counts) {
+        if (texture_) {
+            float rgba[4];
+            if (modulateTexture_) {
+                integratePixelTexture<UseWeightWindow, true>(x, y, rgba, counts);
+            } else {
+                integratePixelTexture<UseWeightWindow, false>(x, y, rgba, counts);
+            }
+            store_colour<Components>(dstPix, rgba);
+        } else {
+            float value, alpha;
+            integratePixel<UseWeightWindow>(x, y, value, alpha, counts);
+            store_pixel<Components>(dstPix, value, alpha);
+        }
+    }
 
-    void setVectorYImg(OFX::Image *v) { vectorYImg_ = v; }
+    // preview - integrates one pixel per previewStride_ x previewStride_ block, blocks start at the tile origin
+    // (tiles are a multiple of 8 pixels, so they line up across tiles)
+    void processBlocks(const OfxRectI &procWindow, LICStepCounts *counts) {
+        int stride = previewStride_;
 
-    void setFrequency(float d) { frequency = d; }
+        for (int y = procWindow.y1; y < procWindow.y2; y += stride) {
+            if (_effect.abort()) break;
 
-    void setNumSteps(int d) { num_steps = d; }
+            int rows = std::min(stride, procWindow.y2 - y);
+            for (int x = procWindow.x1; x < procWindow.x2; x += stride) {
+                PIX pixel[Components];
+                integrateAndStore(x, y, pixel, counts);
 
-    void setUseWeightWindow(bool x) { use_weight_window = x; }
+                int cols = std::min(stride, procWindow.x2 - x);
+                for (int j = 0; j < rows; j++) {
+                    auto dstPix = (PIX *) _dstImg->getPixelAddress(x, y + j);
+                    for (int i = 0; i < cols; i++) {
+                        std::memcpy(dstPix + i * Components, pixel, sizeof(pixel));
+                    }
+                }
+            }
+        }
+    }
 
-    void setWeightWindowWidth(int d) { weight_window_width = d; }
+public :
+    explicit LICProcessor(OFX::ImageEffect &instance) : LICProcessorBase(instance) {}
 
-    void setWeightWindowOffset(int d) { weight_window_offset = d; }
+    const char *name() const override { return "standard"; }
 
-    void setMyDebugTime(double d) { _debug_time = d; }
+    void processTile(const OfxRectI &procWindow, LICStepCounts *counts) override {
+        assert(component_count(_dstImg->getPixelComponents()) == Components);
 
-    void multiThreadProcessImages(OfxRectI procWindow) override {
-        assert(_dstImg->getPixelComponents() == OFX::ePixelComponentRGBA);
+        if (previewStride_ > 1) {
+            processBlocks(procWindow, counts);
+            return;
+        }
 
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if (_effect.abort()) break;
 
-            auto dstPix = (float *) _dstImg->getPixelAddress(procWindow.x1, y);
+            auto dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
             for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                auto px0 = (float) x, py0 = (float) y;
-                float px, py, weight;
-                float acc = 0.0f;
-                float weightSum = 0.0f;
-
-                //bool debug_print = x%200 == 0 && y % 200 == 0; // XXX
-                //bool debug_print = x == 600 && y == 400; // XXX
-                bool debug_print = false;
-                if (debug_print) {
-                    printf("--- bake x=%d y=%d t=%lf numsteps=%d www=%d wwo=%d\n", x, y, _debug_time, num_steps, weight_window_width, weight_window_offset); // XXX
+                integrateAndStore(x, y, dstPix, counts);
+
+                // increment the dst pixel
+                dstPix += Components;
+            }
+        }
+    }
+};
+
+// Same integration as LICProcessor, but the noise samples along each streamline are kept in a StreamlineCache.
+// When the next render has the same streamlines (same vectors, noise and num_steps - typically when only
+// weight_window_offset is animated), the integration is skipped and the cached samples are just summed up
+// with the new weights. Results are identical to LICProcessor.
+template<typename PIX, int Components>
+class CachedLICProcessor : public LICProcessorBase {
+protected :
+    // caches of previous renders, the one for this render (if it's a hit) and the one filled by this render
+    // (if it's a miss)
+    StreamlineCacheSet &caches_;
+    std::shared_ptr<const StreamlineCache> cached_;
+    std::shared_ptr<StreamlineCache> filling_;
+    bool hit_;
+
+    // integrates the streamline through pixel (x, y), putting noise samples into samples[-num_steps..num_steps]
+    // and adding the steps to counts; returns false when it starts at an invalid vector
+    bool traceSamples(int x, int y, float *samples, LICStepCounts &counts) {
+        auto px0 = (float) x, py0 = (float) y;
+        samples[0] = sampleRandomData(px0, py0);
+
+        float ux_initial, uy_initial;
+        if (!sampleDirection(px0, py0, ux_initial, uy_initial)) {
+            return false;
+        }
+
+        for (int sign = +1; sign >= -1; sign -= 2) {
+            float px = px0, py = py0;
+            float ux = ux_initial, uy = uy_initial;
+            float ux_last = ux_initial, uy_last = uy_initial;
+            bool use_last = false;
+
+            for (int i = 0; i < num_steps; i++) {
+                if (!use_last && !sampleDirection(px, py, ux, uy)) {
+                    // same as in LICProcessor, continue in the last known direction
+                    use_last = true;
+                }
+                if (use_last) {
+                    ux = ux_last;
+                    uy = uy_last;
                 }
 
-                weight = getStepWeight(0);
-                acc += weight * sampleRandomData(px0, py0);
-                weightSum += weight;
-                float ux = sampleImageData(vectorXImg_, px0, py0);
-                float uy = sampleImageData(vectorYImg_, px0, py0);
-                float ux_initial = ux, uy_initial = uy;
-                float ux_last = ux_initial, uy_last = uy_initial;
-                bool use_last = false;
-
-                if (debug_print) {
-                    printf("initial weight=%.3f ux_initial=%.3f uy_initial=%.3f\n", weight, ux, uy); // XXX
+                if (sign > 0) {
+                    px += ux;
+                    py += uy;
+                } else {
+                    px -= ux;
+                    py -= uy;
                 }
+                samples[sign * (i + 1)] = sampleRandomData(px, py);
+                ux_last = ux;
+                uy_last = uy;
+                counts.extrapolatedSteps += use_last;
+            }
+        }
+        counts.steps += 2 * num_steps;
+        return true;
+    }
 
-                if (ux != 0 || uy != 0) {
-                    // integrate forward
-                    px = px0, py = py0;
-                    for (int i = 0; i < num_steps; i++) {
-                        if (!use_last) {
-                            ux = sampleImageData(vectorXImg_, px, py);
-                            uy = sampleImageData(vectorYImg_, px, py);
-                        } else {
-                            ux = ux_last;
-                            uy = uy_last;
-                        }
-
-                        // normalize
-                        float umag = sqrtf(ux * ux + uy * uy);
-                        ux /= umag;
-                        uy /= umag;
-
-                        if (std::isnan(ux) || std::isnan(uy) || (ux == 0 && uy == 0)) {
-                            // we're out of picture / out of area where vectors are defined,
-                            // so we will imagine that the vector field goes in the last known direction to infinity
-                            use_last = true;
-                            ux = ux_last;
-                            uy = uy_last;
-                        }
-
-                        px += ux;
-                        py += uy;
-                        float value = sampleRandomData(px, py);
-                        weight = getStepWeight(i+1);
-                        acc += weight * value;
-                        weightSum += weight;
-                        ux_last = ux;
-                        uy_last = uy;
-
-                        if (debug_print) {
-                            printf("step %+d weight=%.3f ux=%.3f uy=%.3f px=%.3f py=%.3f\n", i+1, weight, ux, uy, px, py); // XXX
-                        }
-                    }
+public :
+    CachedLICProcessor(OFX::ImageEffect &instance, StreamlineCacheSet &caches)
+            : LICProcessorBase(instance), caches_(caches), hit_(false) {}
 
-                    // integrate backward
-                    px = px0, py = py0;
-                    ux_last = ux_initial, uy_last = uy_initial;
-                    use_last = false;
-                    for (int i = 0; i < num_steps; i++) {
-                        if (!use_last) {
-                            ux = sampleImageData(vectorXImg_, px, py);
-                            uy = sampleImageData(vectorYImg_, px, py);
-                        } else {
-                            ux = ux_last;
-                            uy = uy_last;
-                        }
-
-                        // normalize
-                        float umag = sqrtf(ux * ux + uy * uy);
-                        ux /= umag;
-                        uy /= umag;
-
-                        if (std::isnan(ux) || std::isnan(uy) || (ux == 0 && uy == 0)) {
-                            // we're out of picture / out of area where vectors are defined,
-                            // so we will imagine that the vector field goes in the last known direction to infinity
-                            use_last = true;
-                            ux = ux_last;
-                            uy = uy_last;
-                        }
-
-                        px -= ux;
-                        py -= uy;
-                        float value = sampleRandomData(px, py);
-                        weight = getStepWeight(-i-1);
-                        acc += weight * value;
-                        weightSum += weight;
-                        ux_last = ux;
-                        uy_last = uy;
-
-                        if (debug_print) {
-                            printf("step %+d weight=%.3f ux=%.3f uy=%.3f px=%.3f py=%.3f\n", -i-1, weight, ux, uy, px, py); // XXX
-                        }
-                    }
+    // the cache filled by this render, or nullptr
+    std::shared_ptr<const StreamlineCache> filledCache() const { return filling_; }
+
+    const char *name() const override { return "cached"; }
+
+    void preProcess() override {
+        LICProcessorBase::preProcess();
+
+        const OfxRectI &rw = _renderWindow;
+        StreamlineCacheKey key = {directionField_->hash(), RectI{rw.x1, rw.y1, rw.x2, rw.y2}, frequency,
+                                  noise.type(), noise.seed(), noiseTexture_ != nullptr, num_steps, bilinearVectors_};
+        cached_ = caches_.find(key);
+        hit_ = cached_ != nullptr;
+        if (!hit_ && StreamlineCache::bytesFor(key.window, num_steps) <= StreamlineCache::kMaxBytes) {
+            filling_ = std::make_shared<StreamlineCache>(key);
+        }
+    }
+
+    void processTile(const OfxRectI &procWindow, LICStepCounts *counts) override {
+        assert(component_count(_dstImg->getPixelComponents()) == Components);
+
+        // for windows too big to be cached
+        std::vector<float> scratch(filling_ || hit_ ? 0 : 2 * num_steps + 1);
+        LICStepCounts tileCounts;
+
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            if (_effect.abort()) break;
+
+            auto dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+                const float *samples;
+                bool valid;
+                if (hit_) {
+                    samples = cached_->samples(x, y);
+                    valid = cached_->valid(x, y);
                 } else {
-                    // we're starting at a null vector; no point in integrating,
-                    // treat this the same as NaN and mask this pixel in output
-                    if (debug_print) {
-                        printf("special case - starting at null vector!\n"); // XXX
-                    }
-                    acc = 0.0f;
-                    weightSum = 0.0f;
+                    float *s = filling_ ? filling_->samples(x, y) : scratch.data() + num_steps;
+                    valid = traceSamples(x, y, s, tileCounts);
+                    if (filling_) filling_->valid(x, y) = valid;
+                    samples = s;
                 }
 
-                float value = acc / weightSum;
-                float alpha = 1.0f;
-                if (weightSum < 0.5f) {
-                    value = 0.0f;
-                    alpha = 0.0f;
+                float value = 0.0f;
+                float alpha = 0.0f;
+                if (valid && weightSum_ >= 0.5f) {
+                    // same order of summation as LICProcessor
+                    float acc = weights_[0] * samples[0];
+                    for (int i = 1; i <= num_steps; i++) {
+                        acc += weights_[i] * samples[i];
+                    }
+                    for (int i = 1; i <= num_steps; i++) {
+                        acc += weights_[-i] * samples[-i];
+                    }
+                    value = acc / weightSum_;
+                    alpha = 1.0f;
+                } else {
+                    tileCounts.maskedPixels++;
                 }
 
-                dstPix[0] = value; // = R
-                dstPix[1] = value; // = G
-                dstPix[2] = value; // = B
-                dstPix[3] = alpha; // = A
+                store_pixel<Components>(dstPix, value, alpha);
+                dstPix += Components;
+            }
+        }
 
-                // increment the dst pixel
-                dstPix += 4;
+        if (counts) *counts += tileCounts;
+    }
+};
+
+// Fast LIC, see LICIntegrator::integrateFastLICTile()
+class FastLICProcessor : public LICProcessorBase {
+protected :
+    template<typename PIX, int Components>
+    void storeTile(const OfxRectI &procWindow, const float *accumulated, const int *hits,
+                   LICStepCounts &counts) {
+        int width = procWindow.x2 - procWindow.x1;
+
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            auto dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+                int idx = (y - procWindow.y1) * width + (x - procWindow.x1);
+                float value, alpha;
+                fastLICPixel(accumulated[idx], hits[idx], value, alpha);
+                counts.maskedPixels += alpha == 0.0f;
+
+                store_pixel<Components>(dstPix, value, alpha);
+                dstPix += Components;
+            }
+        }
+    }
+
+public :
+    explicit FastLICProcessor(OFX::ImageEffect &instance) : LICProcessorBase(instance) {}
+
+    int tileSize() const override { return kFastLICTileSize; }
+
+    const char *name() const override { return "fast_lic"; }
+
+    void processTile(const OfxRectI &procWindow, LICStepCounts *counts) override {
+        assert(is_one_of(_dstImg->getPixelComponents(), {OFX::ePixelComponentRGBA, OFX::ePixelComponentAlpha}));
+
+        int width = procWindow.x2 - procWindow.x1;
+        int height = procWindow.y2 - procWindow.y1;
+        size_t tilePixels = (size_t) width * height;
+        ArenaBuffer accumulatedBuffer = BufferArena::acquire(arena_, tilePixels * sizeof(float));
+        ArenaBuffer hitsBuffer = BufferArena::acquire(arena_, tilePixels * sizeof(int));
+        auto accumulated = accumulatedBuffer.data<float>();
+        auto hits = hitsBuffer.data<int>();
+        std::memset(accumulated, 0, tilePixels * sizeof(float));
+        std::memset(hits, 0, tilePixels * sizeof(int));
+
+        LICStepCounts tileCounts;
+        RectI tile = {procWindow.x1, procWindow.y1, procWindow.x2, procWindow.y2};
+        if (!integrateFastLICTile(tile, accumulated, hits, tileCounts, [this]() { return _effect.abort(); })) {
+            if (counts) *counts += tileCounts;
+            return;
+        }
+
+        bool alphaOutput = _dstImg->getPixelComponents() == OFX::ePixelComponentAlpha;
+        if (_dstImg->getPixelDepth() == OFX::eBitDepthHalf) {
+            if (alphaOutput) {
+                storeTile<uint16_t, 1>(procWindow, accumulated, hits, tileCounts);
+            } else {
+                storeTile<uint16_t, 4>(procWindow, accumulated, hits, tileCounts);
+            }
+        } else {
+            if (alphaOutput) {
+                storeTile<float, 1>(procWindow, accumulated, hits, tileCounts);
+            } else {
+                storeTile<float, 4>(procWindow, accumulated, hits, tileCounts);
+            }
+        }
+
+        if (counts) *counts += tileCounts;
+    }
+};
+
+// Same integration as LICProcessor with baked noise, but running the SIMD row kernel from lic_simd.h
+class SimdLICProcessor : public LICProcessorBase {
+protected :
+    SimdRowKernel rowKernel_;
+    SimdKernelArgs kernelArgs_;
+    ArenaBuffer noiseData_;
+
+public :
+    SimdLICProcessor(OFX::ImageEffect &instance, SimdRowKernel rowKernel)
+            : LICProcessorBase(instance), rowKernel_(rowKernel), kernelArgs_() {}
+
+    bool requiresNoiseTexture() const override { return true; }
+
+    const char *name() const override { return "simd"; }
+
+    void preProcess() override {
+        LICProcessorBase::preProcess();
+
+        // contiguous copy of the noise, +1 for the bilinear neighbour
+        const RectI &db = directionField_->bounds();
+        RectI noiseBounds = {db.x1, db.y1, db.x2 + 1, db.y2 + 1};
+        noiseData_ = BufferArena::acquire(arena_, sizeof(float) * noiseBounds.width() * noiseBounds.height());
+        noiseTexture_->copyRegion(noiseBounds, noiseData_.data<float>());
+
+        kernelArgs_.directionField = directionField_;
+        kernelArgs_.noise = noiseData_.data<const float>();
+        kernelArgs_.noiseBounds = noiseBounds;
+        kernelArgs_.numSteps = num_steps;
+        kernelArgs_.weights = weights_;
+        kernelArgs_.weightSum = weightSum_;
+        kernelArgs_.forwardSteps = forwardSteps_;
+        kernelArgs_.backwardSteps = backwardSteps_;
+        kernelArgs_.halfOutput = _dstImg->getPixelDepth() == OFX::eBitDepthHalf;
+        kernelArgs_.dstComponents = component_count(_dstImg->getPixelComponents());
+        kernelArgs_.bilinearVectors = bilinearVectors_;
+    }
+
+    void processTile(const OfxRectI &procWindow, LICStepCounts *counts) override {
+        assert(is_one_of(_dstImg->getPixelComponents(), {OFX::ePixelComponentRGBA, OFX::ePixelComponentAlpha}));
+
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            if (_effect.abort()) break;
+
+            void *dstPix = _dstImg->getPixelAddress(procWindow.x1, y);
+            rowKernel_(kernelArgs_, y, procWindow.x1, procWindow.x2, dstPix);
+
+            if (counts) {
+                // the kernel doesn't count, but it always takes all the steps of valid pixels
+                for (int x = procWindow.x1; x < procWindow.x2; x++) {
+                    bool valid = directionField_->isValid(x, y) && weightSum_ >= 0.5f;
+                    counts->steps += valid ? 2 * num_steps : 0;
+                    counts->maskedPixels += !valid;
+                }
             }
         }
     }
 };
 
+enum KernelEnum {
+    eKernelStandard = 0,
+    eKernelFastLIC,
+    eKernelSIMD,
+};
+
+enum PreviewEnum {
+    ePreviewOff = 0,
+    ePreviewBlocks2,
+    ePreviewBlocks4,
+};
+
+enum OutputEnum {
+    eOutputRGBA = 0,
+    eOutputAlpha,
+};
+
+enum ChannelEnum {
+    eChannelR = 0,
+    eChannelG,
+    eChannelB,
+    eChannelA,
+};
+
+enum TextureModeEnum {
+    eTextureModulate = 0,
+    eTextureSmear,
+};
+
+// A finished render kept for temporal LIC, see LICPlugin::blendTemporal()
+struct TemporalFrame {
+    double time;
+    double renderScale;
+    // output components, and whether it's colour LIC (-1 for grey, otherwise the texture mode) -
+    // a frame is only blended into renders with the same
+    int components;
+    int colourMode;
+    // render window, always the whole frame - see LICPlugin::coversFrame()
+    RectI window;
+    // premultiplied RGBA of the render window, coverage in alpha
+    TextureField pixels;
+
+    bool isCompatible(const TemporalFrame &other) const {
+        return renderScale == other.renderScale && components == other.components &&
+               colourMode == other.colourMode && window.x1 == other.window.x1 && window.y1 == other.window.y1 &&
+               window.x2 == other.window.x2 && window.y2 == other.window.y2;
+    }
+};
+
 class LICPlugin : public OFX::ImageEffect {
 protected :
+    OFX::Clip *vectorsClip_;
     OFX::Clip *vectorXClip_;
     OFX::Clip *vectorYClip_;
+    OFX::Clip *textureClip_;
     OFX::Clip *dstClip_;
+    OFX::ChoiceParam *vector_x_channel_;
+    OFX::ChoiceParam *vector_y_channel_;
     OFX::DoubleParam *frequency_;
+    OFX::ChoiceParam *noise_type_;
+    OFX::IntParam *seed_;
     OFX::IntParam *num_steps_;
+    OFX::ChoiceParam *integrator_;
+    OFX::ChoiceParam *vector_sampling_;
+    OFX::ChoiceParam *boundary_;
+    OFX::BooleanParam *multi_scale_;
     OFX::BooleanParam *use_weight_window_;
     OFX::IntParam *weight_window_width_;
     OFX::IntParam *weight_window_offset_;
+    OFX::BooleanParam *bake_noise_;
+    OFX::ChoiceParam *kernel_;
+    OFX::ChoiceParam *output_;
+    OFX::ChoiceParam *texture_mode_;
+    OFX::ChoiceParam *preview_;
+    OFX::BooleanParam *cache_streamlines_;
+    OFX::BooleanParam *temporal_;
+    OFX::DoubleParam *temporal_blend_;
+    OFX::DoubleParam *temporal_speed_;
+
+    // Baked noise is kept across renders, it only depends on frequency and render scale.
+    // Renders may run concurrently: each takes a snapshot with std::atomic_load and keeps it alive while
+    // processing; a published texture is never modified, extending it means baking a copy and swapping it in.
+    // Only that takes the mutex, renders which find their tiles already baked don't lock anything.
+    std::shared_ptr<const NoiseTexture> noiseTexture_;
+    OFX::MultiThread::Mutex noiseTextureMutex_;
+
+    // Noise samples along the streamlines of the last renders with cache_streamlines, a cache is never modified
+    // once published and lookups don't lock, see StreamlineCacheSet
+    StreamlineCacheSet streamlineCaches_;
+
+    // Scratch buffers of renders (packed vectors, noise copies, tile accumulators), kept for the next render
+    BufferArena bufferArena_;
+
+    // Last renders with temporal on - two, so that rendering a frame again still finds the one before it.
+    // Published the same way as the noise texture: renders take a snapshot with std::atomic_load, storing a frame
+    // copies the array under the mutex and swaps the copy in.
+    typedef std::array<std::shared_ptr<const TemporalFrame>, 2> TemporalFrames;
+    std::shared_ptr<const TemporalFrames> temporalFrames_;
+    OFX::MultiThread::Mutex temporalMutex_;
 
 public :
     explicit LICPlugin(OfxImageEffectHandle handle)
-            : ImageEffect(handle), vectorXClip_(nullptr), vectorYClip_(nullptr), dstClip_(nullptr), frequency_(nullptr),
-              num_steps_(nullptr) {
+            : ImageEffect(handle), vectorsClip_(nullptr), vectorXClip_(nullptr), vectorYClip_(nullptr),
+              textureClip_(nullptr), dstClip_(nullptr), frequency_(nullptr), num_steps_(nullptr) {
+#ifdef DEBUG
         fprintf(stderr, "LICPlugin::LICPlugin()...\n");
+#endif
 
+        vectorsClip_ = fetchClip("Vectors");
         vectorXClip_ = fetchClip("VectorX");
         vectorYClip_ = fetchClip("VectorY");
+        textureClip_ = fetchClip("Texture");
         dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
 
+        vector_x_channel_ = fetchChoiceParam("vector_x_channel");
+        vector_y_channel_ = fetchChoiceParam("vector_y_channel");
         frequency_ = fetchDoubleParam("frequency");
+        noise_type_ = fetchChoiceParam("noise_type");
+        seed_ = fetchIntParam("seed");
         num_steps_ = fetchIntParam("num_steps");
+        integrator_ = fetchChoiceParam("integrator");
+        vector_sampling_ = fetchChoiceParam("vector_sampling");
+        boundary_ = fetchChoiceParam("boundary");
+        multi_scale_ = fetchBooleanParam("multi_scale");
         use_weight_window_ = fetchBooleanParam("use_weight_window");
         weight_window_width_ = fetchIntParam("weight_window_width");
         weight_window_offset_ = fetchIntParam("weight_window_offset");
+        bake_noise_ = fetchBooleanParam("bake_noise");
+        kernel_ = fetchChoiceParam("kernel");
+        output_ = fetchChoiceParam("output");
+        texture_mode_ = fetchChoiceParam("texture_mode");
+        preview_ = fetchChoiceParam("preview");
+        cache_streamlines_ = fetchBooleanParam("cache_streamlines");
+        temporal_ = fetchBooleanParam("temporal");
+        temporal_blend_ = fetchDoubleParam("temporal_blend");
+        temporal_speed_ = fetchDoubleParam("temporal_speed");
+
+#ifdef LIC_HAVE_OPENCL
+        updateOpenCLSupport(0);
+#endif
     }
 
+    /* Clips with the X and Y vectors - both are the Vectors clip when it's connected */
+    OFX::Clip *xClip() const { return vectorsClip_->isConnected() ? vectorsClip_ : vectorXClip_; }
+
+    OFX::Clip *yClip() const { return vectorsClip_->isConnected() ? vectorsClip_ : vectorYClip_; }
+
+    /* Channels of the vector images with X and Y, the separate clips always have them in the first one */
+    void vectorChannelsAt(double time, int &xChannel, int &yChannel);
+
     /* Override the render */
     void render(const OFX::RenderArguments &args) override;
 
+    /* Output is defined where both vector images are (or the Vectors image is) */
+    bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) override;
+
+    /* Streamlines reach num_steps pixels out of the render window */
+    void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) override;
+
+    /* Output components depend on the output param and the texture */
+    void getClipPreferences(OFX::ClipPreferencesSetter &clipPreferences) override;
+
+    /* Temporal LIC needs the vectors of the previous frame too */
+    void getFramesNeeded(const OFX::FramesNeededArguments &args, OFX::FramesNeededSetter &frames) override;
+
+    /* Drop the baked noise and idle scratch buffers when host is running low on memory */
+    void purgeCaches() override;
+
+    /* Make sure the baked noise covers given region, baking any missing tiles */
+    std::shared_ptr<const NoiseTexture> prepareNoiseTexture(const NoiseFunction &noise, float frequency,
+                                                            double renderScale, const RectI &region);
+
+    /* Noise type and seed params at given time */
+    NoiseFunction noiseFunctionAt(double time);
+
     /* set up and run a processor */
-    void setupAndProcess(LICProcessor &, const OFX::RenderArguments &args);
+    void setupAndProcess(LICProcessorBase &, const OFX::RenderArguments &args);
+
+    /* Temporal LIC - blends the finished render with the previous frame moved along the vectors,
+       and keeps the result for the next frame */
+    void blendTemporal(OFX::Image &dst, OFX::Image &vectorX, OFX::Image &vectorY, const DirectionField &directionField,
+                       const OFX::RenderArguments &args, int colourMode);
+
+    /* Whether the render window covers the whole output - temporal LIC only keeps and blends whole frames,
+       tiles of a frame would find each other's history */
+    bool coversFrame(const OFX::RenderArguments &args);
+
+    /* Kept render for given time compatible with frame, or nullptr */
+    std::shared_ptr<const TemporalFrame> findTemporalFrame(const TemporalFrame &frame, double time);
+
+    void storeTemporalFrame(const std::shared_ptr<const TemporalFrame> &frame);
+
+#ifdef LIC_HAVE_OPENCL
+    /* What the OpenCL kernel can't do of the settings at given time, or nullptr if it can render them */
+    const char *openCLUnsupportedAt(double time);
+
+    /* Tells the host whether this instance can render on the GPU with the current settings */
+    void updateOpenCLSupport(double time);
+
+    void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName) override;
+
+    void changedClip(const OFX::InstanceChangedArgs &args, const std::string &clipName) override;
+
+    /* render on the GPU, with images in OpenCL buffers */
+    void renderOpenCL(const OFX::RenderArguments &args);
+#endif
+
+    /* render with CachedLICProcessor writing given pixel type */
+    template<typename PIX>
+    void renderCached(const OFX::RenderArguments &args);
+
+    /* render with LICProcessor writing given pixel type */
+    template<typename PIX>
+    void renderStandard(const OFX::RenderArguments &args, bool use_weight_window, int previewStride);
+};
+
+static inline void finish_row(DirectionField &field, int y) { field.normalizeRow(y); }
+
+static inline void finish_row(MotionField &field, int y) { field.scaleRow(y); }
+
+// Packs one channel of X and Y vector images into a DirectionField on the host's threads, with pack_vector_row()
+// (see lic_core.h). The pixel type (float or uint16_t for half float) is the template parameter, half floats are
+// widened when packing, so that the processors only ever see float directions.
+// X and Y can be two channels of the same image (the Vectors clip), that is read in one pass.
+// The field is a DirectionField, or a MotionField for temporal LIC which keeps the raw vectors.
+template<typename PIX, typename Field>
+class VectorPackProcessor : public OFX::MultiThread::Processor {
+    Field &field_;
+    LICImageT<const PIX> vectorX_;
+    LICImageT<const PIX> vectorY_;
+    int xChannel_, yChannel_;
+
+public :
+    VectorPackProcessor(Field &field, const OFX::Image &vectorX, const OFX::Image &vectorY, int xChannel, int yChannel)
+            : field_(field), vectorX_(lic_image<PIX>(vectorX)), vectorY_(lic_image<PIX>(vectorY)),
+              xChannel_(xChannel), yChannel_(yChannel) {}
+
+    void multiThreadFunction(unsigned int threadIndex, unsigned int threadMax) override {
+        const RectI &fb = field_.bounds();
+        int y1 = fb.y1 + (int) ((long long) fb.height() * threadIndex / threadMax);
+        int y2 = fb.y1 + (int) ((long long) fb.height() * (threadIndex + 1) / threadMax);
+
+        for (int y = y1; y < y2; y++) {
+            pack_vector_row(field_.row(y), fb, y, vectorX_, xChannel_, vectorY_, yChannel_);
+            finish_row(field_, y);
+        }
+    }
+};
+
+// both vector images have the same bit depth, see LICPlugin::setupAndProcess; vectorX and vectorY may be
+// the same image, with X and Y in different channels
+template<typename Field>
+static void packVectors(Field &field, OFX::Image &vectorX, OFX::Image &vectorY, int xChannel, int yChannel) {
+    if (vectorX.getPixelDepth() == OFX::eBitDepthHalf) {
+        VectorPackProcessor<uint16_t, Field> packer(field, vectorX, vectorY, xChannel, yChannel);
+        packer.multiThread();
+    } else {
+        VectorPackProcessor<float, Field> packer(field, vectorX, vectorY, xChannel, yChannel);
+        packer.multiThread();
+    }
+}
+
+// Packs the texture image into a TextureField on the host's threads, with pack_texture_row() (see lic_core.h)
+template<typename PIX>
+class TexturePackProcessor : public OFX::MultiThread::Processor {
+    TextureField &field_;
+    LICImageT<const PIX> img_;
+
+public :
+    TexturePackProcessor(TextureField &field, const OFX::Image &img) : field_(field), img_(lic_image<PIX>(img)) {}
+
+    void multiThreadFunction(unsigned int threadIndex, unsigned int threadMax) override {
+        const RectI &fb = field_.bounds();
+        int y1 = fb.y1 + (int) ((long long) fb.height() * threadIndex / threadMax);
+        int y2 = fb.y1 + (int) ((long long) fb.height() * (threadIndex + 1) / threadMax);
+
+        for (int y = y1; y < y2; y++) {
+            pack_texture_row(field_.row(y), fb, y, img_);
+        }
+    }
+};
+
+static void packTexture(TextureField &field, OFX::Image &texture) {
+    if (texture.getPixelDepth() == OFX::eBitDepthHalf) {
+        TexturePackProcessor<uint16_t> packer(field, texture);
+        packer.multiThread();
+    } else {
+        TexturePackProcessor<float> packer(field, texture);
+        packer.multiThread();
+    }
+}
+
+// Step counts are in full resolution pixels, proxy renders take proportionally fewer steps (still one pixel long),
+// so that streamlines cover the same part of the image at a fraction of the cost
+static int scaled_steps(int steps, double renderScale, int minSteps) {
+    return std::max(minSteps, (int) std::lround(steps * renderScale));
+}
+
+// Same scaling for the weight window offset, which can be negative
+static int scaled_offset(int offset, double renderScale) {
+    return (int) std::lround(offset * renderScale);
+}
+
+static size_t row_bytes(const OFX::Image &img, const OfxRectI &window) {
+    int bytesPerComponent = img.getPixelDepth() == OFX::eBitDepthHalf ? 2 : 4;
+    return (size_t) (window.x2 - window.x1) * component_count(img.getPixelComponents()) * bytesPerComponent;
+}
+
+static size_t window_bytes(const OFX::Image &img, const OfxRectI &window) {
+    return row_bytes(img, window) * (window.y2 - window.y1);
+}
+
+// Output for pixels without a valid vector
+static void fill_transparent(OFX::Image &dst, const OfxRectI &window) {
+    size_t rowBytes = row_bytes(dst, window);
+    for (int y = window.y1; y < window.y2; y++) {
+        std::memset(dst.getPixelAddress(window.x1, y), 0, rowBytes);
+    }
+}
+
+// Copies the window from a contiguous buffer of rows into the image, and back
+static void copy_window(OFX::Image &dst, const OfxRectI &window, const char *src) {
+    size_t rowBytes = row_bytes(dst, window);
+    for (int y = window.y1; y < window.y2; y++, src += rowBytes) {
+        std::memcpy(dst.getPixelAddress(window.x1, y), src, rowBytes);
+    }
+}
+
+static void copy_window(char *dst, OFX::Image &src, const OfxRectI &window) {
+    size_t rowBytes = row_bytes(src, window);
+    for (int y = window.y1; y < window.y2; y++, dst += rowBytes) {
+        std::memcpy(dst, src.getPixelAddress(window.x1, y), rowBytes);
+    }
+}
+
+// Builds one level of a FieldPyramid on the host's threads
+class PyramidBuildProcessor : public OFX::MultiThread::Processor {
+    FieldPyramid &pyramid_;
+    int level_;
+
+public :
+    PyramidBuildProcessor(FieldPyramid &pyramid, int level) : pyramid_(pyramid), level_(level) {}
+
+    void multiThreadFunction(unsigned int threadIndex, unsigned int threadMax) override {
+        const RectI &lb = pyramid_.bounds(level_);
+        pyramid_.buildRows(level_, lb.y1 + (int) ((long long) lb.height() * threadIndex / threadMax),
+                           lb.y1 + (int) ((long long) lb.height() * (threadIndex + 1) / threadMax));
+    }
+};
+
+// Blends the finished render with the previous frame on the host's threads, and copies the result into
+// the next TemporalFrame - see LICPlugin::blendTemporal(). previous and previousMotion can be nullptr.
+template<typename PIX, int Components>
+class TemporalBlendProcessor : public OFX::MultiThread::Processor {
+    OFX::Image &dst_;
+    const DirectionField &directionField_;
+    TemporalFrame &frame_;
+    const TemporalFrame *previous_;
+    const MotionField &motion_;
+    const MotionField *previousMotion_;
+    float amount_;
+
+public :
+    TemporalBlendProcessor(OFX::Image &dst, const DirectionField &directionField, TemporalFrame &frame,
+                           const TemporalFrame *previous, const MotionField &motion,
+                           const MotionField *previousMotion, float amount)
+            : dst_(dst), directionField_(directionField), frame_(frame), previous_(previous), motion_(motion),
+              previousMotion_(previousMotion), amount_(amount) {}
+
+    void multiThreadFunction(unsigned int threadIndex, unsigned int threadMax) override {
+        const RectI &fb = frame_.pixels.bounds();
+        int y1 = fb.y1 + (int) ((long long) fb.height() * threadIndex / threadMax);
+        int y2 = fb.y1 + (int) ((long long) fb.height() * (threadIndex + 1) / threadMax);
+
+        for (int y = y1; y < y2; y++) {
+            auto dstPix = (PIX *) dst_.getPixelAddress(fb.x1, y);
+            float *kept = frame_.pixels.row(y);
+
+            for (int x = fb.x1; x < fb.x2; x++, dstPix += Components, kept += 4) {
+                // Alpha output has no coverage of its own, it's where the vectors are
+                float rgba[4];
+                if (Components == 4) {
+                    for (int c = 0; c < 4; c++) rgba[c] = to_float(dstPix[c]);
+                } else {
+                    rgba[0] = rgba[1] = rgba[2] = to_float(dstPix[0]);
+                    rgba[3] = directionField_.isValid(x, y) ? 1.0f : 0.0f;
+                }
+
+                if (previous_) {
+                    float px, py;
+                    temporal_backtrace(motion_, previousMotion_, x, y, px, py);
+                    temporal_blend(rgba, previous_->pixels, px, py, amount_);
+                    if (Components == 4) {
+                        for (int c = 0; c < 3; c++) from_float(rgba[c], dstPix[c]);
+                    } else {
+                        from_float(rgba[0], dstPix[0]);
+                    }
+                }
+                std::memcpy(kept, rgba, sizeof(rgba));
+            }
+        }
+    }
 };
 
-void LICPlugin::setupAndProcess(LICProcessor &processor, const OFX::RenderArguments &args) {
+template<typename PIX>
+static void blendTemporalFrame(OFX::Image &dst, const DirectionField &directionField, TemporalFrame &frame,
+                               const TemporalFrame *previous, const MotionField &motion,
+                               const MotionField *previousMotion, float amount) {
+    if (dst.getPixelComponents() == OFX::ePixelComponentAlpha) {
+        TemporalBlendProcessor<PIX, 1> blender(dst, directionField, frame, previous, motion, previousMotion, amount);
+        blender.multiThread();
+    } else {
+        TemporalBlendProcessor<PIX, 4> blender(dst, directionField, frame, previous, motion, previousMotion, amount);
+        blender.multiThread();
+    }
+}
+
+void LICPlugin::setupAndProcess(LICProcessorBase &processor, const OFX::RenderArguments &args) {
     std::unique_ptr<OFX::Image> dst(dstClip_->fetchImage(args.time));
-    std::unique_ptr<OFX::Image> vectorX(vectorXClip_->fetchImage(args.time));
-    std::unique_ptr<OFX::Image> vectorY(vectorYClip_->fetchImage(args.time));
+    // with the Vectors clip, there's just the one image for both
+    std::unique_ptr<OFX::Image> vectorX(xClip()->fetchImage(args.time));
+    std::unique_ptr<OFX::Image> vectorYImg(yClip() != xClip() ? yClip()->fetchImage(args.time) : nullptr);
+    OFX::Image *vectorY = yClip() != xClip() ? vectorYImg.get() : vectorX.get();
+    // colour LIC, only LICProcessor integrates the texture (see render())
+    std::unique_ptr<OFX::Image> texture(textureClip_->isConnected() ? textureClip_->fetchImage(args.time) : nullptr);
     double frequency = frequency_->getValueAtTime(args.time);
-    int num_steps = num_steps_->getValueAtTime(args.time);
+    NoiseFunction noise = noiseFunctionAt(args.time);
+    int num_steps = scaled_steps(num_steps_->getValueAtTime(args.time), args.renderScale.x, 1);
     bool use_weight_window = use_weight_window_->getValueAtTime(args.time);
-    int weight_window_width = weight_window_width_->getValueAtTime(args.time);
-    int weight_window_offset = weight_window_offset_->getValueAtTime(args.time);
-
-    if (!dst || !vectorX || !vectorY) {
+    int weight_window_width = scaled_steps(weight_window_width_->getValueAtTime(args.time), args.renderScale.x, 1);
+    int weight_window_offset = scaled_offset(weight_window_offset_->getValueAtTime(args.time), args.renderScale.x);
+    int integrator, vector_sampling, boundary;
+    integrator_->getValueAtTime(args.time, integrator);
+    vector_sampling_->getValueAtTime(args.time, vector_sampling);
+    boundary_->getValueAtTime(args.time, boundary);
+    // the pyramid is built from the baked noise, see render() for the kernel
+    bool multi_scale = multi_scale_->getValueAtTime(args.time) && integrator == eIntegratorEuler;
+    bool bake_noise = bake_noise_->getValueAtTime(args.time) || processor.requiresNoiseTexture() || multi_scale;
+    int texture_mode;
+    texture_mode_->getValueAtTime(args.time, texture_mode);
+    int xChannel, yChannel;
+    vectorChannelsAt(args.time, xChannel, yChannel);
+    bool temporal = temporal_->getValueAtTime(args.time);
+    // previews would leave blocks in the kept frame, tiles are rendered as plain LIC
+    bool temporalBlend = temporal && processor.previewStride() == 1 && coversFrame(args);
+
+    if (!dst || !vectorX || !vectorY || (textureClip_->isConnected() && !texture)) {
         fprintf(stderr, "LICPlugin::setupAndProcess did not get all images, some are NULL\n");
         throw int(1); // XXX need to throw an sensible exception here!
     }
 
-    if (dst->getPixelDepth() != OFX::eBitDepthFloat ||
-        vectorX->getPixelDepth() != OFX::eBitDepthFloat ||
-        vectorY->getPixelDepth() != OFX::eBitDepthFloat)
+    if (!is_one_of(dst->getPixelDepth(), {OFX::eBitDepthFloat, OFX::eBitDepthHalf}) ||
+        !is_one_of(vectorX->getPixelDepth(), {OFX::eBitDepthFloat, OFX::eBitDepthHalf}) ||
+        vectorY->getPixelDepth() != vectorX->getPixelDepth() ||
+        (texture && !is_one_of(texture->getPixelDepth(), {OFX::eBitDepthFloat, OFX::eBitDepthHalf})))
     {
-        fprintf(stderr, "LICPlugin::setupAndProcess got image with pixel depth != float\n");
+        fprintf(stderr, "LICPlugin::setupAndProcess got image with pixel depth other than float or half\n");
         throw int(1); // XXX need to throw an sensible exception here!
     }
 
     if (!is_one_of(vectorX->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
         !is_one_of(vectorY->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
-        dst->getPixelComponents() != OFX::ePixelComponentRGBA)
+        !is_one_of(dst->getPixelComponents(), {OFX::ePixelComponentRGBA, OFX::ePixelComponentAlpha}) ||
+        (texture && !is_one_of(texture->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA})))
     {
         fprintf(stderr, "LICPlugin::setupAndProcess got image with unsupported pixel components\n");
         throw int(1); // XXX need to throw an sensible exception here!
     }
 
+    if (xChannel >= component_count(vectorX->getPixelComponents()) ||
+        yChannel >= component_count(vectorY->getPixelComponents()))
+    {
+        fprintf(stderr, "LICPlugin::setupAndProcess got vector image without the selected channel\n");
+        throw int(1); // XXX need to throw an sensible exception here!
+    }
+
+    // streamlines go at most num_steps pixels away from the render window, +1 for rounding, +1 for the bilinear tap
+    const OfxRectI &rw = args.renderWindow;
+    RectI sampleRegion = RectI{rw.x1, rw.y1, rw.x2, rw.y2}.expanded(num_steps + 2);
+
+    DirectionField directionField;
+    directionField.reset(sampleRegion, &bufferArena_);
+    packVectors(directionField, *vectorX, *vectorY, xChannel, yChannel);
+
+    // every streamline would start on an invalid vector, there's nothing to integrate
+    if (!directionField.anyValid(RectI{rw.x1, rw.y1, rw.x2, rw.y2})) {
+        fill_transparent(*dst, args.renderWindow);
+        return;
+    }
+
+    // the texture is packed over the same region, so that it's sampled wherever the vectors are
+    TextureField textureField;
+    if (texture) {
+        textureField.reset(sampleRegion, &bufferArena_);
+        packTexture(textureField, *texture);
+    }
+
+    // finished renders are looked up by everything they depend on, vectors by content rather than the time
+    // so that frames with static vectors share the entry; previews are not worth keeping, and temporal renders
+    // also depend on the previous frame
+    DiskCache *diskCache = temporal ? nullptr : DiskCache::instance();
+    HashBuilder diskCacheKey;
+    DiskCacheFormat diskCacheFormat = {rw.x2 - rw.x1, rw.y2 - rw.y1, component_count(dst->getPixelComponents()),
+                                       dst->getPixelDepth() == OFX::eBitDepthHalf ? 2 : 4};
+    if (diskCache && processor.previewStride() == 1) {
+        int kernel;
+        kernel_->getValueAtTime(args.time, kernel);
+        diskCacheKey
+                .add(kDiskCacheVersion)
+                .add(directionField.hash())
+                .add(args.renderWindow)
+                .add(args.renderScale.x)
+                .add(frequency)
+                .add(noise.type())
+                .add(noise.seed())
+                .add(num_steps)
+                .add(integrator)
+                .add(vector_sampling)
+                .add(boundary)
+                .add(multi_scale)
+                .add(use_weight_window)
+                .add(weight_window_width)
+                .add(weight_window_offset)
+                .add(bake_noise)
+                .add(texture ? textureField.hash() : 0)
+                .add(texture ? texture_mode : -1)
+                .add(kernel)
+                .add((int) getSimdInstructionSet())
+                .add((int) dst->getPixelDepth())
+                .add((int) dst->getPixelComponents());
+
+        std::unique_ptr<MappedFile> entry = diskCache->find(diskCacheKey, diskCacheFormat,
+                                                            window_bytes(*dst, args.renderWindow));
+        if (entry) {
+            copy_window(*dst, args.renderWindow, (const char *) entry->data());
+            return;
+        }
+    }
+
     // set the images
     processor.setDstImg(dst.get());
-    processor.setVectorXImg(vectorX.get());
-    processor.setVectorYImg(vectorY.get());
-    processor.setFrequency((float) frequency);
+    processor.setDirectionField(&directionField);
+    processor.setBufferArena(&bufferArena_);
+    processor.setNoiseFunction(noise);
+    // frequency is per full resolution pixel
+    processor.setFrequency((float) (frequency / args.renderScale.x));
     processor.setNumSteps(num_steps);
+    processor.setIntegrator(integrator);
+    processor.setBilinearVectors(vector_sampling == eVectorSamplingBilinear);
+    processor.setStopAtBoundary(boundary == eBoundaryStop);
     processor.setUseWeightWindow(use_weight_window);
     processor.setWeightWindowWidth(weight_window_width);
     processor.setWeightWindowOffset(weight_window_offset);
-    processor.setMyDebugTime(args.time);
+    if (texture) {
+        processor.setTexture(&textureField);
+        processor.setModulateTexture(texture_mode == eTextureModulate);
+    }
+
+    std::shared_ptr<const NoiseTexture> noiseTexture;
+    if (bake_noise) {
+        // +1 for the bilinear neighbour, in case the processor copies the texels out
+        noiseTexture = prepareNoiseTexture(noise, (float) frequency, args.renderScale.x, sampleRegion.expanded(1));
+        processor.setNoiseTexture(noiseTexture.get());
+    }
+
+    FieldPyramid pyramid;
+    if (multi_scale) {
+        pyramid.reset(directionField, *noiseTexture, LICIntegrator::multiScaleLevels(num_steps), &bufferArena_);
+        for (int level = 1; level <= pyramid.numLevels(); level++) {
+            PyramidBuildProcessor builder(pyramid, level);
+            builder.multiThread();
+        }
+        processor.setFieldPyramid(&pyramid);
+    }
 
     // set the render window
     processor.setRenderWindow(args.renderWindow);
 
+    // optional instrumentation, see render_stats.h
+    StatsLog *statsLog = StatsLog::instance();
+    std::unique_ptr<RenderStats> stats;
+    if (statsLog) {
+        stats.reset(new RenderStats(OFX::MultiThread::getNumCPUs()));
+        processor.setStats(stats.get());
+    }
+    auto start = std::chrono::steady_clock::now();
+
     processor.process();
+
+    if (stats) {
+        statsLog->write(stats->toJson(processor.name(), RectI{rw.x1, rw.y1, rw.x2, rw.y2}, num_steps,
+                                      processor.previewStride(), start, std::chrono::steady_clock::now()));
+    }
+
+    if (temporalBlend && !abort()) {
+        blendTemporal(*dst, *vectorX, *vectorY, directionField, args, texture ? texture_mode : -1);
+    }
+
+    if (diskCache && processor.previewStride() == 1 && !abort()) {
+        ArenaBuffer data = bufferArena_.acquire(window_bytes(*dst, args.renderWindow));
+        copy_window(data.data<char>(), *dst, args.renderWindow);
+        diskCache->store(diskCacheKey, diskCacheFormat, data.data(), data.size());
+    }
+}
+
+void LICPlugin::blendTemporal(OFX::Image &dst, OFX::Image &vectorX, OFX::Image &vectorY,
+                              const DirectionField &directionField, const OFX::RenderArguments &args,
+                              int colourMode) {
+    const OfxRectI &rw = args.renderWindow;
+    RectI window = {rw.x1, rw.y1, rw.x2, rw.y2};
+    auto amount = (float) temporal_blend_->getValueAtTime(args.time);
+    // motion is per full resolution pixel
+    auto speed = (float) (temporal_speed_->getValueAtTime(args.time) * args.renderScale.x);
+    int xChannel, yChannel;
+    vectorChannelsAt(args.time, xChannel, yChannel);
+
+    auto frame = std::make_shared<TemporalFrame>();
+    frame->time = args.time;
+    frame->renderScale = args.renderScale.x;
+    frame->components = component_count(dst.getPixelComponents());
+    frame->colourMode = colourMode;
+    frame->window = window;
+    frame->pixels.reset(window, &bufferArena_);
+
+    // without the previous frame (first frame, jumps in time, changed output) this is plain LIC
+    std::shared_ptr<const TemporalFrame> previous = findTemporalFrame(*frame, args.time - 1);
+    MotionField motion, previousMotion;
+    bool hasPreviousMotion = false;
+    if (previous) {
+        motion.reset(window, speed, &bufferArena_);
+        packVectors(motion, vectorX, vectorY, xChannel, yChannel);
+
+        // the previous vectors are looked up where the content was, anywhere in the ROI (beyond it
+        // they are clamped to its edge, motion that fast isn't followed closely anyway)
+        std::unique_ptr<OFX::Image> prevX(xClip()->fetchImage(args.time - 1));
+        std::unique_ptr<OFX::Image> prevYImg(yClip() != xClip() ? yClip()->fetchImage(args.time - 1) : nullptr);
+        OFX::Image *prevY = yClip() != xClip() ? prevYImg.get() : prevX.get();
+        if (prevX && prevY && prevX->getPixelDepth() == vectorX.getPixelDepth() &&
+            prevX->getPixelComponents() == vectorX.getPixelComponents() &&
+            prevY->getPixelComponents() == vectorY.getPixelComponents()) {
+            previousMotion.reset(directionField.bounds(), speed, &bufferArena_);
+            packVectors(previousMotion, *prevX, *prevY, xChannel, yChannel);
+            hasPreviousMotion = true;
+        }
+    }
+
+    if (dst.getPixelDepth() == OFX::eBitDepthHalf) {
+        blendTemporalFrame<uint16_t>(dst, directionField, *frame, previous.get(), motion,
+                                     hasPreviousMotion ? &previousMotion : nullptr, amount);
+    } else {
+        blendTemporalFrame<float>(dst, directionField, *frame, previous.get(), motion,
+                                  hasPreviousMotion ? &previousMotion : nullptr, amount);
+    }
+
+    if (!abort()) {
+        storeTemporalFrame(frame);
+    }
+}
+
+bool LICPlugin::coversFrame(const OFX::RenderArguments &args) {
+    OfxRectD rod = dstClip_->getRegionOfDefinition(args.time);
+    double par = dstClip_->getPixelAspectRatio();
+    auto x1 = (int) std::floor(rod.x1 * args.renderScale.x / par);
+    auto y1 = (int) std::floor(rod.y1 * args.renderScale.y);
+    auto x2 = (int) std::ceil(rod.x2 * args.renderScale.x / par);
+    auto y2 = (int) std::ceil(rod.y2 * args.renderScale.y);
+    const OfxRectI &rw = args.renderWindow;
+    return rw.x1 <= x1 && rw.y1 <= y1 && rw.x2 >= x2 && rw.y2 >= y2;
+}
+
+std::shared_ptr<const TemporalFrame> LICPlugin::findTemporalFrame(const TemporalFrame &frame, double time) {
+    std::shared_ptr<const TemporalFrames> frames = std::atomic_load(&temporalFrames_);
+    if (!frames) return nullptr;
+    for (const auto &kept: *frames) {
+        if (kept && std::abs(kept->time - time) < 1e-3 && kept->isCompatible(frame)) {
+            return kept;
+        }
+    }
+    return nullptr;
+}
+
+void LICPlugin::storeTemporalFrame(const std::shared_ptr<const TemporalFrame> &frame) {
+    OFX::MultiThread::AutoMutex lock(temporalMutex_);
+    std::shared_ptr<const TemporalFrames> frames = std::atomic_load(&temporalFrames_);
+    auto updated = frames ? std::make_shared<TemporalFrames>(*frames) : std::make_shared<TemporalFrames>();
+
+    // replaces the same frame rendered before, otherwise the oldest one
+    size_t slot = 0;
+    for (size_t i = 0; i < updated->size(); i++) {
+        const auto &kept = (*updated)[i];
+        if (!kept || kept->time == frame->time) {
+            slot = i;
+            break;
+        }
+        if (kept->time < (*updated)[slot]->time) slot = i;
+    }
+    (*updated)[slot] = frame;
+    std::atomic_store(&temporalFrames_, std::shared_ptr<const TemporalFrames>(updated));
+}
+
+// Bakes noise texture tiles on the host's threads
+class NoiseBakeProcessor : public OFX::MultiThread::Processor {
+    NoiseTexture &texture_;
+    const std::vector<int> &tiles_;
+
+public :
+    NoiseBakeProcessor(NoiseTexture &texture, const std::vector<int> &tiles) : texture_(texture), tiles_(tiles) {}
+
+    void multiThreadFunction(unsigned int threadIndex, unsigned int threadMax) override {
+        for (size_t i = threadIndex; i < tiles_.size(); i += threadMax) {
+            texture_.bakeTile(tiles_[i]);
+        }
+    }
+};
+
+std::shared_ptr<const NoiseTexture> LICPlugin::prepareNoiseTexture(const NoiseFunction &noise, float frequency,
+                                                                   double renderScale, const RectI &region) {
+    std::shared_ptr<const NoiseTexture> texture = std::atomic_load(&noiseTexture_);
+    if (texture && texture->isCompatible(noise, frequency, renderScale) && texture->covers(region)) {
+        return texture;
+    }
+
+    OFX::MultiThread::AutoMutex lock(noiseTextureMutex_);
+
+    // another render may have baked it while we were waiting
+    texture = std::atomic_load(&noiseTexture_);
+    if (texture && texture->isCompatible(noise, frequency, renderScale) && texture->covers(region)) {
+        return texture;
+    }
+
+    std::shared_ptr<NoiseTexture> updated;
+    if (texture && texture->isCompatible(noise, frequency, renderScale)) {
+        updated = std::make_shared<NoiseTexture>(*texture);
+    } else {
+        updated = std::make_shared<NoiseTexture>(noise, frequency, renderScale);
+    }
+
+    std::vector<int> pending = updated->prepare(region);
+    if (!pending.empty()) {
+        NoiseBakeProcessor baker(*updated, pending);
+        baker.multiThread(std::min(OFX::MultiThread::getNumCPUs(), (unsigned int) pending.size()));
+    }
+
+    texture = updated;
+    std::atomic_store(&noiseTexture_, texture);
+    return texture;
+}
+
+NoiseFunction LICPlugin::noiseFunctionAt(double time) {
+    int noise_type;
+    noise_type_->getValueAtTime(time, noise_type);
+    return NoiseFunction(noise_type, (uint32_t) seed_->getValueAtTime(time));
+}
+
+void LICPlugin::vectorChannelsAt(double time, int &xChannel, int &yChannel) {
+    xChannel = yChannel = 0;
+    if (vectorsClip_->isConnected()) {
+        vector_x_channel_->getValueAtTime(time, xChannel);
+        vector_y_channel_->getValueAtTime(time, yChannel);
+    }
+}
+
+void LICPlugin::purgeCaches() {
+    // renders in progress keep their own snapshot
+    std::atomic_store(&noiseTexture_, std::shared_ptr<const NoiseTexture>());
+    streamlineCaches_.clear();
+    {
+        OFX::MultiThread::AutoMutex lock(temporalMutex_);
+        std::atomic_store(&temporalFrames_, std::shared_ptr<const TemporalFrames>());
+    }
+    bufferArena_.purge();
 }
 
 void LICPlugin::render(const OFX::RenderArguments &args) {
-    if (vectorXClip_->getPixelDepth() != OFX::eBitDepthFloat ||
-        vectorYClip_->getPixelDepth() != OFX::eBitDepthFloat ||
-        dstClip_->getPixelDepth() != OFX::eBitDepthFloat)
+    if (!is_one_of(xClip()->getPixelDepth(), {OFX::eBitDepthFloat, OFX::eBitDepthHalf}) ||
+        !is_one_of(dstClip_->getPixelDepth(), {OFX::eBitDepthFloat, OFX::eBitDepthHalf}) ||
+        yClip()->getPixelDepth() != xClip()->getPixelDepth())
     {
-        fprintf(stderr, "LICPlugin::render got clip with pixel depth != float\n");
+        fprintf(stderr, "LICPlugin::render got clip with pixel depth other than float or half\n");
         OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
     }
 
-    if (!is_one_of(vectorXClip_->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
-        !is_one_of(vectorYClip_->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
-        dstClip_->getPixelComponents() != OFX::ePixelComponentRGBA)
+    if (!is_one_of(xClip()->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
+        !is_one_of(yClip()->getPixelComponents(), {OFX::ePixelComponentAlpha, OFX::ePixelComponentRGB, OFX::ePixelComponentRGBA}) ||
+        !is_one_of(dstClip_->getPixelComponents(), {OFX::ePixelComponentRGBA, OFX::ePixelComponentAlpha}))
     {
         fprintf(stderr, "LICPlugin::render got clip with unsupported pixel components\n");
         OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
     }
 
-    LICProcessor processor(*this);
-    setupAndProcess(processor, args);
+    int xChannel, yChannel;
+    vectorChannelsAt(args.time, xChannel, yChannel);
+    if (xChannel >= component_count(xClip()->getPixelComponents()) ||
+        yChannel >= component_count(yClip()->getPixelComponents()))
+    {
+        fprintf(stderr, "LICPlugin::render got Vectors clip without the selected channel\n");
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+
+#ifdef LIC_HAVE_OPENCL
+    if (args.isEnabledOpenCLRender) {
+        // the images are OpenCL buffers, so there's no falling back to the CPU here; the host was told to render
+        // such settings on the CPU (see updateOpenCLSupport()), this is reached with settings animated into
+        // something the kernel can't do, or hosts that don't look at the instance property
+        const char *unsupported = openCLUnsupportedAt(args.time);
+        if (unsupported) {
+            fprintf(stderr, "LICPlugin::render got an OpenCL render, but the GPU kernel doesn't do %s\n",
+                    unsupported);
+            OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+        }
+        renderOpenCL(args);
+        return;
+    }
+#endif
+
+    int kernel;
+    kernel_->getValueAtTime(args.time, kernel);
+    bool use_weight_window = use_weight_window_->getValueAtTime(args.time);
+    bool cache_streamlines = cache_streamlines_->getValueAtTime(args.time);
+    int integrator, boundary;
+    integrator_->getValueAtTime(args.time, integrator);
+    boundary_->getValueAtTime(args.time, boundary);
+    bool multi_scale = multi_scale_->getValueAtTime(args.time);
+    bool use_texture = textureClip_->isConnected();
+
+    // host renders in response to user interaction can get the blocky preview, later renders refine it
+    int preview;
+    preview_->getValueAtTime(args.time, preview);
+    int previewStride = 1;
+    if (args.interactiveRenderStatus && preview == ePreviewBlocks2) {
+        previewStride = 2;
+    } else if (args.interactiveRenderStatus && preview == ePreviewBlocks4) {
+        previewStride = 4;
+    }
+
+    SimdRowKernel simdRowKernel = getSimdRowKernel(getSimdInstructionSet());
+
+    if (integrator != eIntegratorEuler || boundary == eBoundaryStop || multi_scale || use_texture) {
+        // only the per pixel integration of the Standard kernel does the higher order integrators,
+        // stopping at the boundary, multi-scale and colour LIC
+        if (dstClip_->getPixelDepth() == OFX::eBitDepthHalf) {
+            renderStandard<uint16_t>(args, use_weight_window, previewStride);
+        } else {
+            renderStandard<float>(args, use_weight_window, previewStride);
+        }
+    } else if (kernel == eKernelFastLIC) {
+        FastLICProcessor processor(*this);
+        setupAndProcess(processor, args);
+    } else if (kernel == eKernelSIMD && simdRowKernel) {
+        SimdLICProcessor processor(*this, simdRowKernel);
+        setupAndProcess(processor, args);
+    } else if (cache_streamlines && previewStride == 1 && dstClip_->getPixelDepth() == OFX::eBitDepthHalf) {
+        renderCached<uint16_t>(args);
+    } else if (cache_streamlines && previewStride == 1) {
+        renderCached<float>(args);
+    } else if (dstClip_->getPixelDepth() == OFX::eBitDepthHalf) {
+        // also the fallback for SIMD kernel on CPUs without AVX2/NEON
+        renderStandard<uint16_t>(args, use_weight_window, previewStride);
+    } else {
+        renderStandard<float>(args, use_weight_window, previewStride);
+    }
+}
+
+template<typename PIX>
+void LICPlugin::renderStandard(const OFX::RenderArguments &args, bool use_weight_window, int previewStride) {
+    bool alphaOutput = dstClip_->getPixelComponents() == OFX::ePixelComponentAlpha;
+
+    if (use_weight_window && alphaOutput) {
+        LICProcessor<true, PIX, 1> processor(*this);
+        processor.setPreviewStride(previewStride);
+        setupAndProcess(processor, args);
+    } else if (use_weight_window) {
+        LICProcessor<true, PIX, 4> processor(*this);
+        processor.setPreviewStride(previewStride);
+        setupAndProcess(processor, args);
+    } else if (alphaOutput) {
+        LICProcessor<false, PIX, 1> processor(*this);
+        processor.setPreviewStride(previewStride);
+        setupAndProcess(processor, args);
+    } else {
+        LICProcessor<false, PIX, 4> processor(*this);
+        processor.setPreviewStride(previewStride);
+        setupAndProcess(processor, args);
+    }
+}
+
+#ifdef LIC_HAVE_OPENCL
+const char *LICPlugin::openCLUnsupportedAt(double time) {
+    int integrator, kernel, preview;
+    integrator_->getValueAtTime(time, integrator);
+    kernel_->getValueAtTime(time, kernel);
+    preview_->getValueAtTime(time, preview);
+
+    // the kernel is LICProcessor with baked noise for one pixel type, same as SimdLICProcessor
+    if (integrator != eIntegratorEuler) return "integrators other than Euler";
+    if (multi_scale_->getValueAtTime(time)) return "multi-scale";
+    if (textureClip_->isConnected()) return "colour LIC";
+    if (temporal_->getValueAtTime(time)) return "temporal LIC";
+    if (kernel == eKernelFastLIC) return "Fast LIC";
+    if (preview != ePreviewOff) return "interactive preview";
+    if (kernel != eKernelSIMD && !bake_noise_->getValueAtTime(time)) return "noise that is not baked";
+    if (xClip()->getPixelDepth() != dstClip_->getPixelDepth() ||
+        yClip()->getPixelDepth() != dstClip_->getPixelDepth()) {
+        return "vector and output images with different pixel depths";
+    }
+    return nullptr;
+}
+
+void LICPlugin::updateOpenCLSupport(double time) {
+    // hosts that don't let instances change it keep rendering everything on the GPU, see render()
+    getPropertySet().propSetString(kOfxImageEffectPropOpenCLRenderSupported,
+                                   openCLUnsupportedAt(time) ? "false" : "true", 0, false);
+}
+
+void LICPlugin::changedParam(const OFX::InstanceChangedArgs &args, const std::string &/*paramName*/) {
+    updateOpenCLSupport(args.time);
+}
+
+void LICPlugin::changedClip(const OFX::InstanceChangedArgs &args, const std::string &/*clipName*/) {
+    updateOpenCLSupport(args.time);
+}
+
+static OpenCLImage opencl_image(const OFX::Image &img, int channel = 0) {
+    OfxRectI b = img.getBounds();
+    int bytesPerComponent = img.getPixelDepth() == OFX::eBitDepthHalf ? 2 : 4;
+    return {img.getPixelData(), RectI{b.x1, b.y1, b.x2, b.y2}, component_count(img.getPixelComponents()),
+            img.getRowBytes() / bytesPerComponent, channel};
+}
+
+void LICPlugin::renderOpenCL(const OFX::RenderArguments &args) {
+    std::unique_ptr<OFX::Image> dst(dstClip_->fetchImage(args.time));
+    std::unique_ptr<OFX::Image> vectorX(xClip()->fetchImage(args.time));
+    std::unique_ptr<OFX::Image> vectorYImg(yClip() != xClip() ? yClip()->fetchImage(args.time) : nullptr);
+    OFX::Image *vectorY = yClip() != xClip() ? vectorYImg.get() : vectorX.get();
+    int xChannel, yChannel;
+    vectorChannelsAt(args.time, xChannel, yChannel);
+    double frequency = frequency_->getValueAtTime(args.time);
+    int num_steps = scaled_steps(num_steps_->getValueAtTime(args.time), args.renderScale.x, 1);
+    bool use_weight_window = use_weight_window_->getValueAtTime(args.time);
+    int weight_window_width = scaled_steps(weight_window_width_->getValueAtTime(args.time), args.renderScale.x, 1);
+    int weight_window_offset = scaled_offset(weight_window_offset_->getValueAtTime(args.time), args.renderScale.x);
+    int vector_sampling, boundary;
+    vector_sampling_->getValueAtTime(args.time, vector_sampling);
+    boundary_->getValueAtTime(args.time, boundary);
+
+    if (!dst || !vectorX || !vectorY) {
+        fprintf(stderr, "LICPlugin::renderOpenCL did not get all images, some are NULL\n");
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    // the kernel is built for one pixel type
+    if (dst->getPixelDepth() != vectorX->getPixelDepth()) {
+        fprintf(stderr, "LICPlugin::renderOpenCL got output and vector images with different pixel depths\n");
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+
+    std::vector<float> weightTable;
+    float weightSum = build_step_weights(weightTable, num_steps, use_weight_window,
+                                         weight_window_width, weight_window_offset);
+
+    // same noise as the CPU kernels with baked noise, uploaded for the window streamlines can reach (+1 for
+    // the bilinear neighbour) - see SimdLICProcessor::preProcess()
+    const OfxRectI &rw = args.renderWindow;
+    RectI sampleRegion = RectI{rw.x1, rw.y1, rw.x2, rw.y2}.expanded(num_steps + 1);
+    RectI noiseBounds = {sampleRegion.x1, sampleRegion.y1, sampleRegion.x2 + 1, sampleRegion.y2 + 1};
+    std::shared_ptr<const NoiseTexture> noiseTexture = prepareNoiseTexture(noiseFunctionAt(args.time),
+                                                                           (float) frequency, args.renderScale.x,
+                                                                           noiseBounds);
+    ArenaBuffer noiseData = bufferArena_.acquire(sizeof(float) * noiseBounds.width() * noiseBounds.height());
+    noiseTexture->copyRegion(noiseBounds, noiseData.data<float>());
+
+    OpenCLKernelArgs kernelArgs;
+    kernelArgs.vectorX = opencl_image(*vectorX, xChannel);
+    kernelArgs.vectorY = opencl_image(*vectorY, yChannel);
+    kernelArgs.dst = opencl_image(*dst);
+    kernelArgs.half = dst->getPixelDepth() == OFX::eBitDepthHalf;
+    kernelArgs.renderWindow = RectI{rw.x1, rw.y1, rw.x2, rw.y2};
+    kernelArgs.noise = noiseData.data<const float>();
+    kernelArgs.noiseBounds = noiseBounds;
+    kernelArgs.numSteps = num_steps;
+    kernelArgs.weights = weightTable.data() + num_steps;
+    kernelArgs.weightSum = weightSum;
+    kernelArgs.forwardSteps = weighted_steps(weightTable, num_steps, +1);
+    kernelArgs.backwardSteps = weighted_steps(weightTable, num_steps, -1);
+    kernelArgs.bilinearVectors = vector_sampling == eVectorSamplingBilinear;
+    kernelArgs.stopAtBoundary = boundary == eBoundaryStop;
+
+    if (!licOpenCL(args.pOpenCLCmdQ, kernelArgs)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+    }
+}
+#endif
+
+static OfxRectD intersect_rects(const OfxRectD &a, const OfxRectD &b) {
+    OfxRectD r = {std::max(a.x1, b.x1), std::max(a.y1, b.y1), std::min(a.x2, b.x2), std::min(a.y2, b.y2)};
+    r.x2 = std::max(r.x1, r.x2);
+    r.y2 = std::max(r.y1, r.y2);
+    return r;
+}
+
+bool LICPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) {
+    // pixels outside either of the vector images are masked anyway
+    rod = intersect_rects(xClip()->getRegionOfDefinition(args.time),
+                          yClip()->getRegionOfDefinition(args.time));
+    return true;
+}
+
+void LICPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) {
+    // same as the sample region in setupAndProcess() - one pixel per step, +1 for rounding, +1 for the bilinear tap
+    int num_steps = scaled_steps(num_steps_->getValueAtTime(args.time), args.renderScale.x, 1);
+    double dx = (num_steps + 2) * dstClip_->getPixelAspectRatio() / args.renderScale.x;
+    double dy = (num_steps + 2) / args.renderScale.y;
+    const OfxRectD &rw = args.regionOfInterest;
+    OfxRectD roi = {rw.x1 - dx, rw.y1 - dy, rw.x2 + dx, rw.y2 + dy};
+
+    // vectors (and texture) outside of the images are clamped to the edge, there's no need to ask for them
+    // (unless there's no overlap, then an empty region could get us no image at all)
+    for (OFX::Clip *clip: {vectorsClip_, vectorXClip_, vectorYClip_, textureClip_}) {
+        // when the Vectors clip is connected, the separate ones are not used
+        bool used = clip == xClip() || clip == yClip() || clip == textureClip_;
+        if (!used || !clip->isConnected()) continue;
+        OfxRectD clipped = intersect_rects(roi, clip->getRegionOfDefinition(args.time));
+        bool empty = clipped.x2 <= clipped.x1 || clipped.y2 <= clipped.y1;
+        rois.setRegionOfInterest(*clip, empty ? roi : clipped);
+    }
+}
+
+template<typename PIX>
+void LICPlugin::renderCached(const OFX::RenderArguments &args) {
+    std::shared_ptr<const StreamlineCache> filled;
+
+    if (dstClip_->getPixelComponents() == OFX::ePixelComponentAlpha) {
+        CachedLICProcessor<PIX, 1> processor(*this, streamlineCaches_);
+        setupAndProcess(processor, args);
+        filled = processor.filledCache();
+    } else {
+        CachedLICProcessor<PIX, 4> processor(*this, streamlineCaches_);
+        setupAndProcess(processor, args);
+        filled = processor.filledCache();
+    }
+
+    // an aborted render leaves the cache incomplete
+    if (filled && !abort()) {
+        streamlineCaches_.insert(filled);
+    }
+}
+
+void LICPlugin::getClipPreferences(OFX::ClipPreferencesSetter &clipPreferences) {
+    int output;
+    output_->getValue(output);
+    // colour LIC is always RGBA
+    if (output == eOutputAlpha && !textureClip_->isConnected()) {
+        clipPreferences.setClipComponents(*dstClip_, OFX::ePixelComponentAlpha);
+    }
+}
+
+void LICPlugin::getFramesNeeded(const OFX::FramesNeededArguments &args, OFX::FramesNeededSetter &frames) {
+    // temporal LIC moves the previous frame along with the vectors of both frames
+    OfxRangeD range = {temporal_->getValueAtTime(args.time) ? args.time - 1 : args.time, args.time};
+    frames.setFramesNeeded(*xClip(), range);
+    if (yClip() != xClip()) {
+        frames.setFramesNeeded(*yClip(), range);
+    }
+    if (textureClip_->isConnected()) {
+        frames.setFramesNeeded(*textureClip_, OfxRangeD{args.time, args.time});
+    }
 }
 
 mDeclarePluginFactory(LICPluginFactory, {}, {});
@@ -367,40 +1577,104 @@ mDeclarePluginFactory(LICPluginFactory, {}, {});
 using namespace OFX;
 
 void LICPluginFactory::describe(OFX::ImageEffectDescriptor &desc) {
+#ifdef DEBUG
     fprintf(stderr, "LICPluginFactory::describe...\n");
+#endif
     desc.setLabels("LIC", "LIC", "Line Integral Convolution");
     desc.setPluginGrouping("LIC");
 
     desc.addSupportedContext(eContextGeneral);
 
-    // TODO support half float
     desc.addSupportedBitDepth(eBitDepthFloat);
+    desc.addSupportedBitDepth(eBitDepthHalf);
 
     desc.setSingleInstance(false);
+    // we slice the frame into tiles ourselves, but several frames can be rendered at once
     desc.setHostFrameThreading(false);
-    desc.setSupportsMultiResolution(false);
+    desc.setRenderThreadSafety(eRenderFullySafe);
+    desc.setSupportsMultiResolution(true);
     desc.setSupportsTiles(true);
-    desc.setTemporalClipAccess(false);
+    // the previous frame's vectors, for temporal LIC
+    desc.setTemporalClipAccess(true);
     desc.setRenderTwiceAlways(false);
     desc.setSupportsMultipleClipPARs(false);
+#ifdef LIC_HAVE_OPENCL
+    desc.setSupportsOpenCLRender(true);
+#endif
 }
 
 void LICPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum contextEnum) {
+#ifdef DEBUG
     fprintf(stderr, "LICPluginFactory::describeInContext, context = %d...\n", contextEnum);
+#endif
+    (void) contextEnum;
+    // either the Vectors clip with X and Y in two channels, or the first channel of the Vector X and Vector Y clips
+    auto *vectorsClip = desc.defineClip("Vectors");
+    vectorsClip->addSupportedComponent(ePixelComponentRGB);
+    vectorsClip->addSupportedComponent(ePixelComponentRGBA);
+    vectorsClip->setLabels("Vectors", "Vectors", "Vectors");
+    vectorsClip->setHint("X and Y vectors in one image, see vector_x_channel and vector_y_channel - "
+                         "Vector X and Vector Y are not used when this is connected");
+    vectorsClip->setOptional(true);
+    vectorsClip->setTemporalClipAccess(true);
+
     auto *vectorXClip = desc.defineClip("VectorX");
     vectorXClip->addSupportedComponent(ePixelComponentAlpha);
     vectorXClip->addSupportedComponent(ePixelComponentRGB);
     vectorXClip->addSupportedComponent(ePixelComponentRGBA);
     vectorXClip->setLabels("Vector X", "Vector X", "Vector X");
+    vectorXClip->setOptional(true);
+    vectorXClip->setTemporalClipAccess(true);
 
     auto *vectorYClip = desc.defineClip("VectorY");
     vectorYClip->addSupportedComponent(ePixelComponentAlpha);
-    vectorXClip->addSupportedComponent(ePixelComponentRGB);
-    vectorXClip->addSupportedComponent(ePixelComponentRGBA);
+    vectorYClip->addSupportedComponent(ePixelComponentRGB);
+    vectorYClip->addSupportedComponent(ePixelComponentRGBA);
     vectorYClip->setLabels("Vector Y", "Vector Y", "Vector Y");
+    vectorYClip->setOptional(true);
+    vectorYClip->setTemporalClipAccess(true);
+
+    auto *textureClip = desc.defineClip("Texture");
+    textureClip->addSupportedComponent(ePixelComponentAlpha);
+    textureClip->addSupportedComponent(ePixelComponentRGB);
+    textureClip->addSupportedComponent(ePixelComponentRGBA);
+    textureClip->setLabels("Texture", "Texture", "Texture");
+    textureClip->setHint("optional image integrated along the streamlines instead of the grey noise, see texture_mode");
+    textureClip->setOptional(true);
 
     auto *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentAlpha);
+
+    auto *vector_x_channel = desc.defineChoiceParam("vector_x_channel");
+    vector_x_channel->setLabels("vector_x_channel", "Vectors X", "Vectors X channel");
+    vector_x_channel->setScriptName("vector_x_channel");
+    vector_x_channel->setHint("channel of the Vectors input with the X vectors");
+    assert(vector_x_channel->getNOptions() == eChannelR);
+    vector_x_channel->appendOption("R");
+    assert(vector_x_channel->getNOptions() == eChannelG);
+    vector_x_channel->appendOption("G");
+    assert(vector_x_channel->getNOptions() == eChannelB);
+    vector_x_channel->appendOption("B");
+    assert(vector_x_channel->getNOptions() == eChannelA);
+    vector_x_channel->appendOption("A");
+    vector_x_channel->setDefault(eChannelR);
+    vector_x_channel->setAnimates(false);
+
+    auto *vector_y_channel = desc.defineChoiceParam("vector_y_channel");
+    vector_y_channel->setLabels("vector_y_channel", "Vectors Y", "Vectors Y channel");
+    vector_y_channel->setScriptName("vector_y_channel");
+    vector_y_channel->setHint("channel of the Vectors input with the Y vectors");
+    assert(vector_y_channel->getNOptions() == eChannelR);
+    vector_y_channel->appendOption("R");
+    assert(vector_y_channel->getNOptions() == eChannelG);
+    vector_y_channel->appendOption("G");
+    assert(vector_y_channel->getNOptions() == eChannelB);
+    vector_y_channel->appendOption("B");
+    assert(vector_y_channel->getNOptions() == eChannelA);
+    vector_y_channel->appendOption("A");
+    vector_y_channel->setDefault(eChannelG);
+    vector_y_channel->setAnimates(false);
 
     auto *frequency = desc.defineDoubleParam("frequency");
     frequency->setLabels("frequency", "frequency", "frequency");
@@ -412,6 +1686,29 @@ void LICPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, OFX::
     frequency->setDisplayRange(0, 2);
     frequency->setDoubleType(eDoubleTypeScale);
 
+    auto *noise_type = desc.defineChoiceParam("noise_type");
+    noise_type->setLabels("noise_type", "Noise", "Noise type");
+    noise_type->setScriptName("noise_type");
+    noise_type->setHint("the texture smeared along the streamlines: Simplex is smooth gradient noise, Value "
+                        "interpolates random values on a grid (cheaper to evaluate), White is one random value per "
+                        "grid cell - at frequency 1 one per pixel, the classic LIC look. Value and White come out "
+                        "bit identical on every machine");
+    assert(noise_type->getNOptions() == eNoiseSimplex);
+    noise_type->appendOption("Simplex");
+    assert(noise_type->getNOptions() == eNoiseValue);
+    noise_type->appendOption("Value");
+    assert(noise_type->getNOptions() == eNoiseWhite);
+    noise_type->appendOption("White");
+    noise_type->setDefault(eNoiseSimplex);
+
+    auto *seed = desc.defineIntParam("seed");
+    seed->setLabels("seed", "Seed", "Noise seed");
+    seed->setScriptName("seed");
+    seed->setHint("picks a different noise of the same type and frequency");
+    seed->setDefault(0);
+    seed->setRange(0, 1000000);
+    seed->setDisplayRange(0, 100);
+
     auto *num_steps = desc.defineIntParam("num_steps");
     num_steps->setLabels("num_steps", "Num. steps", "Number of steps");
     num_steps->setScriptName("num_steps");
@@ -420,6 +1717,111 @@ void LICPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, OFX::
     num_steps->setRange(1, 50);
     num_steps->setDisplayRange(1, 50);
 
+    auto *integrator = desc.defineChoiceParam("integrator");
+    integrator->setLabels("integrator", "Integrator", "Streamline integrator");
+    integrator->setScriptName("integrator");
+    integrator->setHint("Euler takes one pixel steps along the vectors, RK2/RK4 follow curved flow more accurately "
+                        "at 2/4 vector lookups per step, Adaptive takes steps of up to 4 pixels where the flow "
+                        "is straight (fewer lookups for the same streamline length); streamlines are num_steps "
+                        "pixels long in all cases. Anything other than Euler uses the Standard kernel and "
+                        "renders on the CPU");
+    assert(integrator->getNOptions() == eIntegratorEuler);
+    integrator->appendOption("Euler");
+    assert(integrator->getNOptions() == eIntegratorRK2);
+    integrator->appendOption("RK2");
+    assert(integrator->getNOptions() == eIntegratorRK4);
+    integrator->appendOption("RK4");
+    assert(integrator->getNOptions() == eIntegratorAdaptive);
+    integrator->appendOption("Adaptive");
+    integrator->setDefault(eIntegratorEuler);
+
+    auto *vector_sampling = desc.defineChoiceParam("vector_sampling");
+    vector_sampling->setLabels("vector_sampling", "Vector sampling", "Vector field sampling");
+    vector_sampling->setScriptName("vector_sampling");
+    vector_sampling->setHint("Nearest takes the vector of the pixel the streamline is in (cheapest, streamlines "
+                             "follow the pixel grid in coarse vector fields), Bilinear interpolates between "
+                             "the four neighbouring pixels for smooth streamlines");
+    assert(vector_sampling->getNOptions() == eVectorSamplingNearest);
+    vector_sampling->appendOption("Nearest");
+    assert(vector_sampling->getNOptions() == eVectorSamplingBilinear);
+    vector_sampling->appendOption("Bilinear");
+    vector_sampling->setDefault(eVectorSamplingNearest);
+
+    auto *boundary = desc.defineChoiceParam("boundary");
+    boundary->setLabels("boundary", "Boundary", "Streamline boundary");
+    boundary->setScriptName("boundary");
+    boundary->setHint("what streamlines do where the valid vectors end (edge of the image, masked areas): Continue "
+                      "goes on in the last known direction, Stop ends the streamline there and averages the part "
+                      "it has (no smearing across the edge, less work near masks). Stop uses the Standard kernel");
+    assert(boundary->getNOptions() == eBoundaryContinue);
+    boundary->appendOption("Continue");
+    assert(boundary->getNOptions() == eBoundaryStop);
+    boundary->appendOption("Stop");
+    boundary->setDefault(eBoundaryContinue);
+
+    auto *multi_scale = desc.defineBooleanParam("multi_scale");
+    multi_scale->setLabels("multi_scale", "Multi-scale", "Multi-scale streamlines");
+    multi_scale->setScriptName("multi_scale");
+    multi_scale->setHint("take the far steps of long streamlines on coarser copies of the vectors and noise: "
+                         "past 8 steps from the pixel, steps are 2, 4 and then 8 pixels long - num_steps 50 takes "
+                         "19 lookups instead of 50 each way, with a softer look far from the pixel. "
+                         "Euler only, uses the Standard kernel with baked noise and renders on the CPU");
+    multi_scale->setDefault(false);
+
+    auto *kernel = desc.defineChoiceParam("kernel");
+    kernel->setLabels("kernel", "Kernel", "LIC kernel");
+    kernel->setScriptName("kernel");
+    kernel->setHint("Standard integrates a streamline for each pixel, Fast LIC reuses long streamlines "
+                    "for all pixels they pass through (much faster for long kernels, slightly different look), "
+                    "Standard (SIMD) integrates several pixels at once using AVX2/NEON (always uses baked noise). "
+                    "Fast LIC renders on the CPU");
+    assert(kernel->getNOptions() == eKernelStandard);
+    kernel->appendOption("Standard");
+    assert(kernel->getNOptions() == eKernelFastLIC);
+    kernel->appendOption("Fast LIC");
+    assert(kernel->getNOptions() == eKernelSIMD);
+    kernel->appendOption("Standard (SIMD)");
+    kernel->setDefault(eKernelStandard);
+
+    auto *output = desc.defineChoiceParam("output");
+    output->setLabels("output", "Output", "Output components");
+    output->setScriptName("output");
+    output->setHint("RGBA is the grey LIC image with alpha masking pixels without a valid vector, "
+                    "Alpha is only the LIC value (masked pixels are 0) - a quarter of the memory");
+    assert(output->getNOptions() == eOutputRGBA);
+    output->appendOption("RGBA");
+    assert(output->getNOptions() == eOutputAlpha);
+    output->appendOption("Alpha");
+    output->setDefault(eOutputRGBA);
+    output->setAnimates(false);
+
+    auto *texture_mode = desc.defineChoiceParam("texture_mode");
+    texture_mode->setLabels("texture_mode", "Texture mode", "Texture mode");
+    texture_mode->setScriptName("texture_mode");
+    texture_mode->setHint("with the Texture input connected, the output is the texture integrated along the "
+                          "streamlines (premultiplied RGBA): Texture x noise multiplies its colour by the noise, "
+                          "giving coloured LIC in one pass, Texture smears it along the flow without any noise. "
+                          "The output is then always RGBA; uses the Standard kernel and renders on the CPU");
+    assert(texture_mode->getNOptions() == eTextureModulate);
+    texture_mode->appendOption("Texture x noise");
+    assert(texture_mode->getNOptions() == eTextureSmear);
+    texture_mode->appendOption("Texture");
+    texture_mode->setDefault(eTextureModulate);
+
+    auto *preview = desc.defineChoiceParam("preview");
+    preview->setLabels("preview", "Interactive preview", "Interactive preview");
+    preview->setScriptName("preview");
+    preview->setHint("for renders the host does while you interact (dragging sliders, scrubbing), integrate only "
+                     "one pixel per block - 4 or 16 times less work; Standard kernel only, renders on the CPU when on");
+    assert(preview->getNOptions() == ePreviewOff);
+    preview->appendOption("Off");
+    assert(preview->getNOptions() == ePreviewBlocks2);
+    preview->appendOption("2x2 blocks");
+    assert(preview->getNOptions() == ePreviewBlocks4);
+    preview->appendOption("4x4 blocks");
+    preview->setDefault(ePreviewOff);
+    preview->setAnimates(false);
+
     auto *use_weight_window = desc.defineBooleanParam("use_weight_window");
     use_weight_window->setLabels("use_weight_window", "Hanning window", "Use weight window");
     use_weight_window->setScriptName("use_weight_window");
@@ -441,10 +1843,61 @@ void LICPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, OFX::
     weight_window_offset->setDefault(0);
     weight_window_offset->setRange(-10000, 10000);
     weight_window_offset->setDisplayRange(-100, 100);
+
+    auto *bake_noise = desc.defineBooleanParam("bake_noise");
+    bake_noise->setLabels("bake_noise", "Bake noise", "Bake noise texture");
+    bake_noise->setScriptName("bake_noise");
+    bake_noise->setHint("sample noise from a cached texture instead of evaluating it at every step - much faster, "
+                        "noise is interpolated between pixels. GPU renders need it (or the SIMD kernel), otherwise "
+                        "they are done on the CPU");
+    bake_noise->setDefault(false);
+
+    auto *cache_streamlines = desc.defineBooleanParam("cache_streamlines");
+    cache_streamlines->setLabels("cache_streamlines", "Cache streamlines", "Cache streamline samples");
+    cache_streamlines->setScriptName("cache_streamlines");
+    cache_streamlines->setHint("keep the noise samples along the streamlines, so that frames which only change "
+                               "the weight window (eg. animated offset over static vectors) are just re-weighted - "
+                               "Standard kernel only, needs 4 * (2 * num_steps + 1) bytes per pixel");
+    cache_streamlines->setDefault(false);
+
+    auto *temporal = desc.defineBooleanParam("temporal");
+    temporal->setLabels("temporal", "Temporal", "Temporal LIC");
+    temporal->setScriptName("temporal");
+    temporal->setHint("blend each frame with the previous one moved along the vectors, for animation that is "
+                      "coherent in time - the streaks get longer from frame to frame, so a shorter num_steps "
+                      "gives the same look (every frame is still a full LIC before the blend, lower num_steps to save "
+                      "work). The output depends on the render order: frames have to be rendered in order by "
+                      "one instance of the effect, the first one, any after a jump in time and renders "
+                      "in tiles are plain LIC - not suitable for renders split between machines or processes. "
+                      "Renders on the CPU");
+    temporal->setDefault(false);
+    temporal->setAnimates(false);
+
+    auto *temporal_blend = desc.defineDoubleParam("temporal_blend");
+    temporal_blend->setLabels("temporal_blend", "Temporal blend", "Temporal blend");
+    temporal_blend->setScriptName("temporal_blend");
+    temporal_blend->setHint("how much of the previous frame is kept - higher is smoother in time and longer streaks");
+    temporal_blend->setDefault(0.8);
+    temporal_blend->setRange(0, 0.99);
+    temporal_blend->setIncrement(0.01);
+    temporal_blend->setDisplayRange(0, 0.95);
+
+    auto *temporal_speed = desc.defineDoubleParam("temporal_speed");
+    temporal_speed->setLabels("temporal_speed", "Temporal speed", "Temporal speed");
+    temporal_speed->setScriptName("temporal_speed");
+    temporal_speed->setHint("motion per frame in (full resolution) pixels for a vector of length 1 - "
+                            "1 for motion vectors, negative reverses the flow");
+    temporal_speed->setDefault(1);
+    temporal_speed->setRange(-100, 100);
+    temporal_speed->setIncrement(0.1);
+    temporal_speed->setDisplayRange(0, 5);
 }
 
 OFX::ImageEffect *LICPluginFactory::createInstance(OfxImageEffectHandle handle, OFX::ContextEnum contextEnum) {
+#ifdef DEBUG
     fprintf(stderr, "LICPluginFactory::createInstance, context = %d...\n", contextEnum);
+#endif
+    (void) contextEnum;
     return new LICPlugin(handle);
 }
 
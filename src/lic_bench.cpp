@@ -0,0 +1,347 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Standalone benchmark and regression check of the LIC kernels on synthetic vector fields, no OFX host needed:
+//
+//   lic_bench [--sizes 512x512,1920x1080] [--steps 5,15,50] [--fields vortex,uniform,noise,masked] [--reps 3]
+//             [--golden DIR] [--update-golden] [--check]
+//
+// Every case is rendered through LICRenderer (see lic_core.h) by each kernel available on this machine
+// (single threaded) and reported in Mpix/s and ns per integration step. The other kernels are compared against
+// the reference kernel of the same run, or with --golden, all of them against reference renders in DIR, which
+// are written by --update-golden from a known good build; the exit status is 1 if any of them differs.
+//
+// --check compares against the golden renders checked in to src/golden, which cover kCheckSizes x kCheckSteps.
+// The noise and the "noise" field are value noise (see noise_function.h) rather than simplex noise, so that
+// the golden renders only depend on code of this repository, not on the SimplexNoise submodule.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "lic_core.h"
+#include "lic_simd.h"
+
+namespace {
+
+const float kFrequency = 0.2f;
+const int kNoiseType = eNoiseValue;
+const float kPi = 3.14159265f;
+// SIMD kernels use FMA, they are not bit exact
+const float kGoldenTolerance = 1e-3f;
+// Fast LIC takes streamlines through nearby pixels instead of the pixel itself, which is a small difference
+// on average but not per pixel - it's compared by the mean difference, and the masked pixels must match
+const float kFastLICMeanTolerance = 0.03f;
+
+// cases of --check, small enough for the golden renders to be checked in
+const char *const kCheckSizes = "64x48";
+const char *const kCheckSteps = "5,15";
+#ifndef LIC_GOLDEN_DIR
+#define LIC_GOLDEN_DIR "golden"
+#endif
+
+struct BenchCase {
+    std::string field;
+    int width, height;
+    int numSteps;
+    bool useWeightWindow;
+    bool bilinearVectors;
+
+    std::string name() const {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%s_%dx%d_s%d_%s_%s", field.c_str(), width, height, numSteps,
+                 useWeightWindow ? "window" : "box", bilinearVectors ? "bilinear" : "nearest");
+        return buf;
+    }
+};
+
+struct BenchKernel {
+    const char *name;
+    bool useSimd;
+    bool fastLic;
+};
+
+// Whether output matches expected for the kernel, with the measured difference in status
+bool matches(const BenchKernel &kernel, const std::vector<float> &output, const std::vector<float> &expected,
+             std::string &status) {
+    float maxDiff = 0.0f;
+    double sumDiff = 0.0;
+    size_t maskMismatches = 0;
+    for (size_t i = 0; i < output.size(); i++) {
+        float diff = std::abs(output[i] - expected[i]);
+        maxDiff = std::max(maxDiff, diff);
+        sumDiff += diff;
+        // masked pixels are 0, valid ones almost never are
+        maskMismatches += (output[i] == 0.0f) != (expected[i] == 0.0f);
+    }
+    auto meanDiff = (float) (sumDiff / (double) output.size());
+
+    bool ok;
+    char buf[96];
+    if (kernel.fastLic) {
+        ok = meanDiff <= kFastLICMeanTolerance && maskMismatches == 0;
+        snprintf(buf, sizeof(buf), "%s (mean diff %.2g, %zu masked differ)", ok ? "ok" : "FAILED", meanDiff,
+                 maskMismatches);
+    } else {
+        ok = maxDiff <= kGoldenTolerance;
+        snprintf(buf, sizeof(buf), "%s (max diff %.2g)", ok ? "ok" : "FAILED", maxDiff);
+    }
+    status = buf;
+    return ok;
+}
+
+// Raw vector of the synthetic field at (x, y)
+void fieldVector(const std::string &field, int width, int height, int x, int y, float &vx, float &vy) {
+    float dx = (float) x - 0.5f * (float) width, dy = (float) y - 0.5f * (float) height;
+    if (field == "uniform") {
+        vx = 1.0f;
+        vy = 0.3f;
+    } else if (field == "noise") {
+        static const NoiseFunction fieldNoise(eNoiseValue, 1);
+        float angle = kPi * fieldNoise.noise(0.01f * (float) x, 0.01f * (float) y);
+        vx = std::cos(angle);
+        vy = std::sin(angle);
+    } else {
+        // vortex, masked is a vortex with a NaN disc and a null rectangle
+        vx = -dy;
+        vy = dx;
+        if (field == "masked") {
+            float cx = (float) x - 0.75f * (float) width, cy = (float) y - 0.25f * (float) height;
+            if (cx * cx + cy * cy < 0.04f * (float) (width * height)) vx = NAN;
+            if (x < width / 4 && y > height / 2) vx = vy = 0.0f;
+        }
+    }
+}
+
+// Interleaved (x, y) vectors of the whole image
+std::vector<float> fillVectors(const BenchCase &c) {
+    std::vector<float> vectors((size_t) 2 * c.width * c.height);
+    for (int y = 0; y < c.height; y++) {
+        for (int x = 0; x < c.width; x++) {
+            float *v = &vectors[2 * ((size_t) y * c.width + x)];
+            fieldVector(c.field, c.width, c.height, x, y, v[0], v[1]);
+        }
+    }
+    return vectors;
+}
+
+std::vector<std::string> parseNames(const char *s) {
+    std::vector<std::string> names;
+    std::string all = s;
+    size_t start = 0;
+    while (start <= all.size()) {
+        size_t end = all.find(',', start);
+        if (end == std::string::npos) end = all.size();
+        names.push_back(all.substr(start, end - start));
+        start = end + 1;
+    }
+    return names;
+}
+
+std::vector<int> parseInts(const char *s) {
+    std::vector<int> values;
+    for (const std::string &name: parseNames(s)) {
+        values.push_back(std::atoi(name.c_str()));
+    }
+    return values;
+}
+
+bool readGolden(const std::string &path, std::vector<float> &values) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    bool ok = fread(values.data(), sizeof(float), values.size(), f) == values.size();
+    fclose(f);
+    return ok;
+}
+
+bool writeGolden(const std::string &path, const std::vector<float> &values) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(values.data(), sizeof(float), values.size(), f) == values.size();
+    return fclose(f) == 0 && ok;
+}
+
+void usage() {
+    fprintf(stderr, "usage: lic_bench [--sizes WxH,...] [--steps N,...] [--fields vortex,uniform,noise,masked] "
+                    "[--reps N] [--golden DIR] [--update-golden] [--check]\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::string sizeList = "512x512,1920x1080";
+    std::string stepList = "5,15,50";
+    std::vector<std::string> fields = {"vortex", "uniform", "noise", "masked"};
+    int reps = 3;
+    std::string goldenDir;
+    bool updateGolden = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            sizeList = argv[++i];
+        } else if (arg == "--steps" && hasValue) {
+            stepList = argv[++i];
+        } else if (arg == "--fields" && hasValue) {
+            fields = parseNames(argv[++i]);
+            for (const std::string &field: fields) {
+                if (field != "vortex" && field != "uniform" && field != "noise" && field != "masked") {
+                    usage();
+                    return 2;
+                }
+            }
+        } else if (arg == "--reps" && hasValue) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--golden" && hasValue) {
+            goldenDir = argv[++i];
+        } else if (arg == "--update-golden") {
+            updateGolden = true;
+        } else if (arg == "--check") {
+            goldenDir = LIC_GOLDEN_DIR;
+            sizeList = kCheckSizes;
+            stepList = kCheckSteps;
+            reps = 1;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (updateGolden && goldenDir.empty()) {
+        usage();
+        return 2;
+    }
+
+    std::vector<std::pair<int, int>> sizes;
+    for (const std::string &s: parseNames(sizeList.c_str())) {
+        int w, h;
+        if (sscanf(s.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+            usage();
+            return 2;
+        }
+        sizes.emplace_back(w, h);
+    }
+    std::vector<int> steps = parseInts(stepList.c_str());
+    for (int n: steps) {
+        if (n < 1) {
+            usage();
+            return 2;
+        }
+    }
+
+    // the reference is the plug-in's per pixel integrator with baked noise, as the SIMD kernels see it
+    std::vector<BenchKernel> kernels = {{"reference", false, false}};
+    SimdInstructionSetEnum instructionSet = getSimdInstructionSet();
+    if (getSimdRowKernel(instructionSet)) {
+        kernels.push_back({instructionSet == eSimdAVX2 ? "avx2" : "neon", true, false});
+    }
+    kernels.push_back({"fastlic", false, true});
+    LICStdThreadPool pool(1);
+
+    printf("%-44s %-10s %10s %10s %10s  %s\n", "case", "kernel", "ms", "Mpix/s", "ns/step", "check");
+    int failures = 0;
+
+    for (const auto &size: sizes) {
+        for (int numSteps: steps) {
+            for (const std::string &field: fields) {
+                for (int variant = 0; variant < 4; variant++) {
+                    BenchCase c = {field, size.first, size.second, numSteps, (variant & 1) != 0, (variant & 2) != 0};
+
+                    std::vector<float> vectors = fillVectors(c);
+                    RectI window = {0, 0, c.width, c.height};
+                    LICConstImage vectorX = {vectors.data(), window, 2, (ptrdiff_t) 2 * c.width};
+                    LICConstImage vectorY = {vectors.data() + 1, window, 2, (ptrdiff_t) 2 * c.width};
+
+                    // Hanning window settings the plug-in defaults to
+                    LICParams params;
+                    params.frequency = kFrequency;
+                    params.noiseType = kNoiseType;
+                    params.numSteps = numSteps;
+                    params.vectorSampling = c.bilinearVectors ? eVectorSamplingBilinear : eVectorSamplingNearest;
+                    params.useWeightWindow = c.useWeightWindow;
+                    params.weightWindowWidth = 5;
+                    params.weightWindowOffset = 0;
+                    params.bakeNoise = true;
+
+                    std::vector<float> golden((size_t) c.width * c.height);
+                    std::string goldenPath = goldenDir + "/" + c.name() + ".raw";
+                    bool haveGolden = !goldenDir.empty() && !updateGolden && readGolden(goldenPath, golden);
+
+                    // without golden renders, the other kernels are checked against this run's reference
+                    std::vector<float> reference;
+
+                    for (const BenchKernel &kernel: kernels) {
+                        params.useSimd = kernel.useSimd;
+                        params.fastLic = kernel.fastLic;
+                        LICRenderer renderer(params);
+                        renderer.prepare(vectorX, vectorY, window, pool);
+
+                        std::vector<float> dst((size_t) c.width * c.height);
+                        LICImage dstImage = {dst.data(), window, 1, c.width};
+                        double best = 1e30;
+                        for (int r = 0; r < reps; r++) {
+                            auto t0 = std::chrono::steady_clock::now();
+                            renderer.render(dstImage, pool);
+                            auto t1 = std::chrono::steady_clock::now();
+                            best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+                        }
+
+                        // the reference kernel's output becomes the golden one
+                        std::string status = "-";
+                        if (updateGolden) {
+                            if (&kernel == &kernels.front()) {
+                                status = writeGolden(goldenPath, dst) ? "written" : "WRITE FAILED";
+                                if (status != "written") failures++;
+                            }
+                        } else if (haveGolden) {
+                            if (!matches(kernel, dst, golden, status)) failures++;
+                        } else if (!goldenDir.empty()) {
+                            status = "missing";
+                            failures++;
+                        } else if (&kernel == &kernels.front()) {
+                            reference = dst;
+                        } else if (!matches(kernel, dst, reference, status)) {
+                            failures++;
+                        }
+
+                        double pixels = (double) c.width * c.height;
+                        printf("%-44s %-10s %10.1f %10.2f %10.3f  %s\n", c.name().c_str(), kernel.name,
+                               best * 1e3, pixels / best * 1e-6, best * 1e9 / (pixels * 2 * numSteps),
+                               status.c_str());
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "lic_bench: %d output(s) differ from the reference\n", failures);
+        return 1;
+    }
+    return 0;
+}
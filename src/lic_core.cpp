@@ -0,0 +1,256 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "lic_core.h"
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include "lic_simd.h"
+#include "tile_scheduler.h"
+
+LICStdThreadPool::LICStdThreadPool(unsigned int numThreads) : numThreads_(numThreads) {
+    if (numThreads_ == 0) {
+        numThreads_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+void LICStdThreadPool::run(const std::function<void(unsigned int, unsigned int)> &fn) {
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numThreads_; i++) {
+        threads.emplace_back(fn, i, numThreads_);
+    }
+    // the calling thread is thread 0
+    fn(0, numThreads_);
+    for (auto &t: threads) {
+        t.join();
+    }
+}
+
+namespace {
+
+// Writes one output pixel of 1 or 4 components, see LICImageT
+inline void storePixel(float *dst, int components, float value, float alpha) {
+    if (components == 4) {
+        store_pixel<4>(dst, value, alpha);
+    } else {
+        store_pixel<1>(dst, value, alpha);
+    }
+}
+
+template<bool UseWeightWindow>
+void integrateTile(LICIntegrator &integrator, const LICImage &dst, const RectI &tile) {
+    for (int y = tile.y1; y < tile.y2; y++) {
+        float *dstPix = dst.pixel(tile.x1, y);
+        for (int x = tile.x1; x < tile.x2; x++) {
+            float value, alpha;
+            integrator.integratePixel<UseWeightWindow>(x, y, value, alpha);
+            storePixel(dstPix, dst.components, value, alpha);
+            dstPix += dst.components;
+        }
+    }
+}
+
+bool fastLICTile(LICIntegrator &integrator, const LICImage &dst, const RectI &tile, std::vector<float> &accumulated,
+                 std::vector<int> &hits, const LICCancelCallback &cancelled) {
+    size_t tilePixels = (size_t) tile.width() * tile.height();
+    accumulated.assign(tilePixels, 0.0f);
+    hits.assign(tilePixels, 0);
+    LICStepCounts counts;
+    if (!integrator.integrateFastLICTile(tile, accumulated.data(), hits.data(), counts,
+                                         [&]() { return cancelled && cancelled(); })) {
+        return false;
+    }
+
+    for (int y = tile.y1; y < tile.y2; y++) {
+        float *dstPix = dst.pixel(tile.x1, y);
+        for (int x = tile.x1; x < tile.x2; x++) {
+            size_t idx = (size_t) (y - tile.y1) * tile.width() + (x - tile.x1);
+            float value, alpha;
+            integrator.fastLICPixel(accumulated[idx], hits[idx], value, alpha);
+            storePixel(dstPix, dst.components, value, alpha);
+            dstPix += dst.components;
+        }
+    }
+    return true;
+}
+
+bool covers(const LICConstImage &img) {
+    return img.data && !img.bounds.isEmpty() && img.components >= 1;
+}
+
+}
+
+LICRenderer::LICRenderer(const LICParams &params, BufferArena *arena)
+        : params_(params), arena_(arena), window_{0, 0, 0, 0}, noiseBounds_{0, 0, 0, 0}, usePyramid_(false) {
+}
+
+LICRenderer::~LICRenderer() = default;
+
+void LICRenderer::prepare(const LICConstImage &vectorX, const LICConstImage &vectorY, const RectI &window,
+                          LICThreadPool &pool) {
+    if (!covers(vectorX) || !covers(vectorY)) {
+        throw std::invalid_argument("licRender: empty vector image");
+    }
+    if (params_.numSteps < 1) {
+        throw std::invalid_argument("licRender: numSteps must be at least 1");
+    }
+    window_ = window;
+
+    // streamlines go at most numSteps pixels away from the window, +1 for rounding, +1 for the bilinear tap
+    directionField_.reset(window.expanded(params_.numSteps + 2), arena_);
+    const RectI &fb = directionField_.bounds();
+
+    pool.run([&](unsigned int threadIndex, unsigned int threadMax) {
+        int y1 = fb.y1 + (int) ((long long) fb.height() * threadIndex / threadMax);
+        int y2 = fb.y1 + (int) ((long long) fb.height() * (threadIndex + 1) / threadMax);
+
+        for (int y = y1; y < y2; y++) {
+            pack_vector_row(directionField_.row(y), fb, y, vectorX, 0, vectorY, 0);
+            directionField_.normalizeRow(y);
+        }
+    });
+
+    bool multiScale = params_.multiScale && params_.integrator == eIntegratorEuler;
+    bool simd = params_.useSimd && params_.integrator == eIntegratorEuler && params_.boundary == eBoundaryContinue &&
+                !multiScale && getSimdRowKernel(getSimdInstructionSet()) != nullptr;
+    noiseTexture_.reset();
+    noiseData_ = ArenaBuffer();
+    if (params_.bakeNoise || simd || multiScale) {
+        NoiseFunction noise(params_.noiseType, params_.seed);
+        noiseTexture_.reset(new NoiseTexture(noise, params_.frequency, 1.0));
+        std::vector<int> tiles = noiseTexture_->prepare(fb.expanded(1));
+        pool.run([&](unsigned int threadIndex, unsigned int threadMax) {
+            for (size_t i = threadIndex; i < tiles.size(); i += threadMax) {
+                noiseTexture_->bakeTile(tiles[i]);
+            }
+        });
+
+        if (simd) {
+            // +1 for the bilinear neighbour
+            noiseBounds_ = {fb.x1, fb.y1, fb.x2 + 1, fb.y2 + 1};
+            noiseData_ = BufferArena::acquire(arena_, sizeof(float) * noiseBounds_.width() * noiseBounds_.height());
+            noiseTexture_->copyRegion(noiseBounds_, noiseData_.data<float>());
+        }
+    }
+
+    usePyramid_ = multiScale;
+    if (multiScale) {
+        pyramid_.reset(directionField_, *noiseTexture_, LICIntegrator::multiScaleLevels(params_.numSteps), arena_);
+        for (int level = 1; level <= pyramid_.numLevels(); level++) {
+            const RectI &lb = pyramid_.bounds(level);
+            pool.run([&](unsigned int threadIndex, unsigned int threadMax) {
+                pyramid_.buildRows(level, lb.y1 + (int) ((long long) lb.height() * threadIndex / threadMax),
+                                   lb.y1 + (int) ((long long) lb.height() * (threadIndex + 1) / threadMax));
+            });
+        }
+    }
+}
+
+bool LICRenderer::render(const LICImage &dst, LICThreadPool &pool, const LICCancelCallback &cancelled) {
+    if (!dst.data || !dst.bounds.contains(window_) || (dst.components != 1 && dst.components != 4)) {
+        throw std::invalid_argument("licRender: output image must cover the window and have 1 or 4 components");
+    }
+
+    // every streamline would start on an invalid vector, there's nothing to integrate
+    if (!directionField_.anyValid(window_)) {
+        for (int y = window_.y1; y < window_.y2; y++) {
+            std::memset(dst.pixel(window_.x1, y), 0, sizeof(float) * window_.width() * dst.components);
+        }
+        return true;
+    }
+
+    LICIntegrator integrator;
+    integrator.setParams(params_);
+    integrator.setDirectionField(&directionField_);
+    integrator.setNoiseTexture(noiseTexture_.get());
+    integrator.setFieldPyramid(usePyramid_ ? &pyramid_ : nullptr);
+    integrator.prepareWeights();
+
+    SimdRowKernel rowKernel = !noiseData_.data() ? nullptr : getSimdRowKernel(getSimdInstructionSet());
+    std::vector<float> simdWeights;
+    SimdKernelArgs kernelArgs = {};
+    if (rowKernel) {
+        kernelArgs.directionField = &directionField_;
+        kernelArgs.noise = noiseData_.data<const float>();
+        kernelArgs.noiseBounds = noiseBounds_;
+        kernelArgs.numSteps = params_.numSteps;
+        kernelArgs.weightSum = build_step_weights(simdWeights, params_.numSteps, params_.useWeightWindow,
+                                                  params_.weightWindowWidth, params_.weightWindowOffset);
+        kernelArgs.weights = simdWeights.data() + params_.numSteps;
+        kernelArgs.forwardSteps = weighted_steps(simdWeights, params_.numSteps, +1);
+        kernelArgs.backwardSteps = weighted_steps(simdWeights, params_.numSteps, -1);
+        kernelArgs.halfOutput = false;
+        kernelArgs.dstComponents = dst.components;
+        kernelArgs.bilinearVectors = params_.vectorSampling == eVectorSamplingBilinear;
+    }
+
+    bool fastLic = params_.fastLic && !usePyramid_ && params_.integrator == eIntegratorEuler &&
+                   params_.boundary == eBoundaryContinue;
+
+    TileScheduler scheduler;
+    scheduler.reset(window_, fastLic ? LICIntegrator::kFastLICTileSize : integrator.defaultTileSize(),
+                    pool.numThreads());
+    std::atomic<bool> stopped(false);
+
+    pool.run([&](unsigned int threadIndex, unsigned int /*threadMax*/) {
+        // Fast LIC tile buffers, reused for the tiles of this thread
+        std::vector<float> accumulated;
+        std::vector<int> hits;
+        RectI tile;
+        while (scheduler.next(threadIndex, tile)) {
+            if (stopped.load(std::memory_order_relaxed) || (cancelled && cancelled())) {
+                stopped.store(true, std::memory_order_relaxed);
+                break;
+            }
+
+            if (fastLic) {
+                if (!fastLICTile(integrator, dst, tile, accumulated, hits, cancelled)) {
+                    stopped.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            } else if (rowKernel) {
+                for (int y = tile.y1; y < tile.y2; y++) {
+                    rowKernel(kernelArgs, y, tile.x1, tile.x2, dst.pixel(tile.x1, y));
+                }
+            } else if (params_.useWeightWindow) {
+                integrateTile<true>(integrator, dst, tile);
+            } else {
+                integrateTile<false>(integrator, dst, tile);
+            }
+        }
+    });
+
+    return !stopped.load();
+}
+
+bool licRender(const LICParams &params, const LICConstImage &vectorX, const LICConstImage &vectorY,
+               const LICImage &dst, const RectI &window, LICThreadPool *pool, const LICCancelCallback &cancelled) {
+    LICStdThreadPool defaultPool;
+    LICThreadPool &threads = pool ? *pool : defaultPool;
+
+    LICRenderer renderer(params);
+    renderer.prepare(vectorX, vectorY, window, threads);
+    return renderer.render(dst, threads, cancelled);
+}
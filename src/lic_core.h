@@ -0,0 +1,871 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "buffer_arena.h"
+#include "direction_field.h"
+#include "field_pyramid.h"
+#include "half_float.h"
+#include "noise_function.h"
+#include "noise_texture.h"
+#include "rect.h"
+#include "step_weights.h"
+#include "texture_field.h"
+
+// Host independent LIC - the integrator shared by the OFX plug-in processors, and a render API on plain
+// float buffers for other consumers (batch pipelines, lic_bench).
+
+enum VectorSamplingEnum {
+    eVectorSamplingNearest = 0,
+    eVectorSamplingBilinear,
+};
+
+enum IntegratorEnum {
+    eIntegratorEuler = 0,
+    eIntegratorRK2,
+    eIntegratorRK4,
+    eIntegratorAdaptive,
+};
+
+// What streamlines do when they leave the area with valid vectors
+enum BoundaryEnum {
+    // go on in the last known direction
+    eBoundaryContinue = 0,
+    // end there, the pixel is the average of the part of the streamline it has
+    eBoundaryStop,
+};
+
+// Parameters of a render, in pixels of the buffers being rendered
+struct LICParams {
+    // noise frequency per pixel
+    float frequency = 0.2f;
+    // NoiseTypeEnum
+    int noiseType = eNoiseSimplex;
+    uint32_t seed = 0;
+    // forward/backward integration steps, one pixel each
+    int numSteps = 15;
+    // IntegratorEnum
+    int integrator = eIntegratorEuler;
+    // VectorSamplingEnum
+    int vectorSampling = eVectorSamplingNearest;
+    // BoundaryEnum
+    int boundary = eBoundaryContinue;
+    bool useWeightWindow = false;
+    int weightWindowWidth = 5;
+    int weightWindowOffset = 0;
+    // sample noise from a baked texture instead of evaluating it at every step
+    bool bakeNoise = false;
+    // use the SIMD row kernel when this CPU has one and the params allow it (Euler, continue at boundary,
+    // always baked noise)
+    bool useSimd = false;
+    // take the far steps of Euler streamlines on a FieldPyramid (always baked noise), see
+    // LICIntegrator::integrateMultiScale()
+    bool multiScale = false;
+    // Fast LIC when the params allow it (Euler, continue at boundary, not multi-scale), see
+    // LICIntegrator::integrateFastLICTile()
+    bool fastLic = false;
+};
+
+// Work done by the integrators, for instrumentation (see render_stats.h). Steps are noise samples along
+// the streamlines; extrapolated are the ones taken in the last known direction after the streamline left
+// the valid vectors.
+struct LICStepCounts {
+    uint64_t steps = 0;
+    uint64_t extrapolatedSteps = 0;
+    uint64_t maskedPixels = 0;
+
+    LICStepCounts &operator+=(const LICStepCounts &other) {
+        steps += other.steps;
+        extrapolatedSteps += other.extrapolatedSteps;
+        maskedPixels += other.maskedPixels;
+        return *this;
+    }
+};
+
+// Per pixel LIC integration over a packed direction field, with noise evaluated or sampled from a baked texture.
+// Set the inputs and parameters, call prepareWeights(), then integratePixel() from any number of threads.
+class LICIntegrator {
+protected :
+    const DirectionField *directionField_;
+    NoiseFunction noise;
+    const NoiseTexture *noiseTexture_;
+    float frequency;
+    int num_steps;
+    bool use_weight_window;
+    int weight_window_width;
+    int weight_window_offset;
+
+    // step weights indexed from -num_steps to +num_steps (weights_ points to the middle of the table)
+    // and their sum, computed once per render
+    std::vector<float> weightTable_;
+    const float *weights_;
+    float weightSum_;
+    // steps up to the last non-zero weight forward and backward, the rest of the streamline isn't integrated
+    int forwardSteps_, backwardSteps_;
+
+    // IntegratorEnum, anything other than Euler is only done by integratePixel()
+    int integrator_;
+
+    // bilinear instead of nearest neighbour direction lookups
+    bool bilinearVectors_;
+
+    // end streamlines where the valid vectors end (eBoundaryStop), only done by integratePixel()
+    bool stopAtBoundary_;
+
+    // coarser levels for the far steps of Euler streamlines, nullptr unless doing multi-scale LIC
+    const FieldPyramid *pyramid_;
+
+    // sampled along the streamlines by integratePixelTexture(), nullptr unless doing colour LIC
+    const TextureField *texture_;
+
+    inline float sampleRandomData(float x, float y) const {
+        if (noiseTexture_) {
+            return noiseTexture_->sample(x, y);
+        }
+        return 0.5 + 0.5 * noise.noise(frequency * x, frequency * y);
+    }
+
+    // returns false if there is no direction at this point (null or NaN vector)
+    inline bool sampleDirection(float x, float y, float &ux, float &uy) {
+        if (bilinearVectors_) {
+            return directionField_->sampleBilinear(x, y, ux, uy);
+        }
+        int x_ = int(x);
+        int y_ = int(y);
+        const float *u = directionField_->at(x_, y_);
+        ux = u[0];
+        uy = u[1];
+        return directionField_->isValid(x_, y_);
+    }
+
+    // What the streamline integration sums up, other than the weights: the noise samples (plain LIC)...
+    struct NoiseAccumulator {
+        static const bool kUsesNoise = true;
+        float value;
+
+        NoiseAccumulator() : value(0.0f) {}
+
+        inline void add(float weight, float noise, float /*x*/, float /*y*/) { value += weight * noise; }
+    };
+
+    // ... or the texture (colour LIC), with the colour multiplied by the noise samples unless it's a smear
+    // of the texture only. Colour and alpha are premultiplied, both are weighted sums.
+    template<bool ModulateByNoise>
+    struct TextureAccumulator {
+        static const bool kUsesNoise = ModulateByNoise;
+        const TextureField *texture;
+        float rgba[4];
+
+        explicit TextureAccumulator(const TextureField *t) : texture(t), rgba{0.0f, 0.0f, 0.0f, 0.0f} {}
+
+        inline void add(float weight, float noise, float x, float y) {
+            float t[4];
+            texture->sample(x, y, t);
+            float w = ModulateByNoise ? weight * noise : weight;
+            rgba[0] += w * t[0];
+            rgba[1] += w * t[1];
+            rgba[2] += w * t[2];
+            rgba[3] += weight * t[3];
+        }
+    };
+
+    // adds the sample at (x, y), evaluating the noise only when the accumulator needs it
+    template<typename Acc>
+    inline void accumulate(Acc &acc, float weight, float x, float y) const {
+        acc.add(weight, Acc::kUsesNoise ? sampleRandomData(x, y) : 0.0f, x, y);
+    }
+
+    // adaptive integrator: steps of 1, 2 or 4 pixels (so that they always end on a whole step and line up
+    // with the weights), doubled while the local error estimate stays under a quarter of the tolerance
+    static const int kMaxAdaptiveStep = 4;
+    static constexpr float kAdaptiveTolerance = 0.05f;
+
+    // One direction (sign = +1 forward, -1 backward) of the streamline with the RK2, RK4 or adaptive integrator,
+    // adding weighted samples to acc and weightSum (and the samples taken to steps and extrapolated).
+    // Streamline length is numSteps pixels as with Euler; when a stage falls on an invalid vector, the step
+    // is taken with Euler instead (and once the streamline gets out of the valid area, it goes on in the last
+    // known direction or stops).
+    template<bool UseWeightWindow, typename Acc>
+    inline void integrateRungeKutta(float px0, float py0, float ux_initial, float uy_initial, float sign,
+                                    int numSteps, Acc &acc, float &weightSum, int &steps, int &extrapolated) {
+        float px = px0, py = py0;
+        float ux, uy, ux_last = ux_initial, uy_last = uy_initial;
+        bool use_last = false;
+        int h = 1;
+
+        for (int t = 0; t < numSteps;) {
+            if (!use_last && !sampleDirection(px, py, ux, uy)) {
+                if (stopAtBoundary_) break;
+                use_last = true;
+            }
+            if (use_last) {
+                ux = ux_last;
+                uy = uy_last;
+            }
+
+            // direction of the step, Euler unless the stages below succeed
+            float dx = ux, dy = uy;
+            int step = 1;
+
+            if (!use_last && integrator_ == eIntegratorRK2) {
+                // midpoint method
+                float k2x, k2y;
+                if (sampleDirection(px + 0.5f * sign * ux, py + 0.5f * sign * uy, k2x, k2y)) {
+                    dx = k2x, dy = k2y;
+                }
+            } else if (!use_last && integrator_ == eIntegratorRK4) {
+                float k2x, k2y, k3x, k3y, k4x, k4y;
+                if (sampleDirection(px + 0.5f * sign * ux, py + 0.5f * sign * uy, k2x, k2y) &&
+                    sampleDirection(px + 0.5f * sign * k2x, py + 0.5f * sign * k2y, k3x, k3y) &&
+                    sampleDirection(px + sign * k3x, py + sign * k3y, k4x, k4y)) {
+                    dx = (ux + 2.0f * k2x + 2.0f * k3x + k4x) / 6.0f;
+                    dy = (uy + 2.0f * k2y + 2.0f * k3y + k4y) / 6.0f;
+                }
+            } else if (integrator_ == eIntegratorAdaptive) {
+                // Heun's method, with the difference from Euler as the error estimate
+                for (;;) {
+                    step = std::min(h, numSteps - t);
+                    float k2x = ux, k2y = uy;
+                    if (!use_last && !sampleDirection(px + step * sign * ux, py + step * sign * uy, k2x, k2y)) {
+                        // ran into the invalid area, approach it slowly
+                        h = step = 1;
+                        break;
+                    }
+                    float error = 0.5f * step * std::sqrt((k2x - ux) * (k2x - ux) + (k2y - uy) * (k2y - uy));
+                    if (error > kAdaptiveTolerance && h > 1) {
+                        h /= 2;
+                        continue;
+                    }
+                    dx = 0.5f * (ux + k2x);
+                    dy = 0.5f * (uy + k2y);
+                    if (error < 0.25f * kAdaptiveTolerance && h < kMaxAdaptiveStep) {
+                        h *= 2;
+                    }
+                    break;
+                }
+            }
+
+            px += sign * step * dx;
+            py += sign * step * dy;
+
+            // the sample stands for all the unit steps it covers
+            float weight = 0.0f;
+            for (int i = t + 1; i <= t + step; i++) {
+                weight += UseWeightWindow ? weights_[(int) sign * i] : 1.0f;
+            }
+            if (weight != 0.0f) {
+                accumulate(acc, weight, px, py);
+                weightSum += weight;
+                steps++;
+                extrapolated += use_last;
+            }
+            t += step;
+
+            if (!use_last) {
+                ux_last = ux;
+                uy_last = uy;
+            }
+        }
+    }
+
+    // multi-scale: steps closer than this to the seed are taken on the field itself, from there each level of
+    // the pyramid takes over for as far again as the streamline got so far (so kMultiScaleNearSteps / 2 steps
+    // on each level, 2, 4 and 8 pixels long)
+    static const int kMultiScaleNearSteps = 8;
+
+    // One direction of an Euler streamline, taking the steps that are 2^level pixels long on that level of
+    // the pyramid - as in integrateRungeKutta(), each sample is weighted by all the unit steps it covers,
+    // and it's taken in the middle of them. Up to kMultiScaleNearSteps it's the same as plain Euler.
+    template<bool UseWeightWindow, typename Acc>
+    inline void integrateMultiScale(float px0, float py0, float ux_initial, float uy_initial, float sign,
+                                    int numSteps, Acc &acc, float &weightSum, int &steps, int &extrapolated) {
+        float px = px0, py = py0;
+        float ux, uy, ux_last = ux_initial, uy_last = uy_initial;
+        bool use_last = false;
+
+        for (int t = 0; t < numSteps;) {
+            int level = 0;
+            while (level < pyramid_->numLevels() && t >= (kMultiScaleNearSteps << level) &&
+                   (2 << level) <= numSteps - t) {
+                level++;
+            }
+            int step = 1 << level;
+
+            if (!use_last && !(level == 0 ? sampleDirection(px, py, ux, uy)
+                                          : pyramid_->sampleDirection(level, px, py, ux, uy))) {
+                if (stopAtBoundary_) break;
+                use_last = true;
+            }
+            if (use_last) {
+                ux = ux_last;
+                uy = uy_last;
+            }
+
+            float weight = 0.0f;
+            for (int i = t + 1; i <= t + step; i++) {
+                weight += UseWeightWindow ? weights_[(int) sign * i] : 1.0f;
+            }
+            if (weight != 0.0f) {
+                float d = 0.5f * (float) (step + 1);
+                float sx = px + sign * d * ux, sy = py + sign * d * uy;
+                float noise = !Acc::kUsesNoise ? 0.0f
+                              : level == 0 ? sampleRandomData(sx, sy) : pyramid_->sampleNoise(level, sx, sy);
+                acc.add(weight, noise, sx, sy);
+                weightSum += weight;
+                steps++;
+                extrapolated += use_last;
+            }
+
+            px += sign * (float) step * ux;
+            py += sign * (float) step * uy;
+            t += step;
+            ux_last = ux;
+            uy_last = uy;
+        }
+    }
+
+    // Integrates a Fast LIC streamline from the seed in one direction (sign = +1 forward, -1 backward), putting
+    // noise samples into samples[sign * step] and indices of tile pixels they fill into pixels[sign * step].
+    // Pixels are filled while the streamline stays on valid vectors inside the tile, after that it goes on
+    // for num_steps more to have the kernel support. Returns number of steps that fill a pixel, adds all
+    // the steps to counts.
+    int traceFastLICStreamline(float px0, float py0, float ux, float uy, int sign, const RectI &tile,
+                               float *samples, int *pixels, LICStepCounts &counts) {
+        float px = px0, py = py0;
+        float ux_last = ux, uy_last = uy;
+        bool use_last = false;
+        int fillSteps = -1;
+        int endStep = kFastLICStreamlineSteps + num_steps;
+
+        for (int i = 0; i < endStep; i++) {
+            if (!use_last && !sampleDirection(px, py, ux, uy)) {
+                // same as in integratePixel(), continue in the last known direction
+                use_last = true;
+            }
+            if (use_last) {
+                ux = ux_last;
+                uy = uy_last;
+            }
+
+            px += (float) sign * ux;
+            py += (float) sign * uy;
+            int k = sign * (i + 1);
+            samples[k] = sampleRandomData(px, py);
+            pixels[k] = -1;
+            ux_last = ux;
+            uy_last = uy;
+            counts.steps++;
+            counts.extrapolatedSteps += use_last;
+
+            if (fillSteps < 0) {
+                // pixel with the seed point closest to the current position
+                int qx = (int) std::floor(px + 0.5f);
+                int qy = (int) std::floor(py + 0.5f);
+
+                if (!use_last && i < kFastLICStreamlineSteps &&
+                    qx >= tile.x1 && qx < tile.x2 && qy >= tile.y1 && qy < tile.y2 &&
+                    directionField_->isValid(qx, qy)) {
+                    pixels[k] = (qy - tile.y1) * tile.width() + (qx - tile.x1);
+                } else {
+                    fillSteps = i;
+                    endStep = i + num_steps;
+                }
+            }
+        }
+
+        return fillSteps < 0 ? endStep : fillSteps;
+    }
+
+public :
+    // Fast LIC (Stalling & Hege, 1995) - how far from the seed (in steps) a streamline keeps filling pixels;
+    // streamlines only fill pixels of their own tile, so bigger tiles mean more reuse and fewer seams
+    static const int kFastLICStreamlineSteps = 100;
+    static const int kFastLICTileSize = 256;
+
+    // Fast LIC of a tile - instead of a fresh streamline for each pixel, integrate long streamlines and slide
+    // the convolution along them, filling every pixel they pass through; new streamlines are seeded from pixels
+    // that are not covered yet, so cost is almost independent of num_steps. Adds the convolved values and
+    // the number of streamlines through each pixel to accumulated and hits (row-major over the tile, zeroed
+    // by the caller, see fastLICPixel()). Returns false as soon as aborted() does, which is polled every row.
+    template<typename Aborted>
+    bool integrateFastLICTile(const RectI &tile, float *accumulated, int *hits, LICStepCounts &counts,
+                              Aborted aborted) {
+        // streamline buffers, indexed by signed step from the seed
+        int maxSteps = kFastLICStreamlineSteps + num_steps;
+        std::vector<float> sampleBuffer(2 * maxSteps + 1);
+        std::vector<int> pixelBuffer(2 * maxSteps + 1);
+        float *samples = sampleBuffer.data() + maxSteps;
+        int *pixels = pixelBuffer.data() + maxSteps;
+
+        const float *weights = weights_;
+        float weightSum = weightSum_;
+
+        for (int y = tile.y1; y < tile.y2; y++) {
+            if (aborted()) return false;
+
+            for (int x = tile.x1; x < tile.x2; x++) {
+                int idx = (y - tile.y1) * tile.width() + (x - tile.x1);
+                float ux, uy;
+                if (hits[idx] > 0 || !sampleDirection((float) x, (float) y, ux, uy)) {
+                    continue;
+                }
+
+                samples[0] = sampleRandomData((float) x, (float) y);
+                pixels[0] = idx;
+                int forwardSteps = traceFastLICStreamline((float) x, (float) y, ux, uy, +1, tile, samples, pixels,
+                                                          counts);
+                int backwardSteps = traceFastLICStreamline((float) x, (float) y, ux, uy, -1, tile, samples, pixels,
+                                                           counts);
+
+                if (!use_weight_window) {
+                    // box filter - running sum along the streamline
+                    double acc = 0.0;
+                    for (int j = -backwardSteps - num_steps; j <= -backwardSteps + num_steps; j++) {
+                        acc += samples[j];
+                    }
+                    for (int k = -backwardSteps; k <= forwardSteps; k++) {
+                        accumulated[pixels[k]] += (float) (acc / weightSum);
+                        hits[pixels[k]]++;
+                        if (k < forwardSteps) {
+                            acc += samples[k + num_steps + 1] - samples[k - num_steps];
+                        }
+                    }
+                } else {
+                    for (int k = -backwardSteps; k <= forwardSteps; k++) {
+                        float acc = 0.0f;
+                        for (int j = -num_steps; j <= num_steps; j++) {
+                            acc += weights[j] * samples[k + j];
+                        }
+                        accumulated[pixels[k]] += acc / weightSum;
+                        hits[pixels[k]]++;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Output of a Fast LIC tile pixel - the average of the streamlines through it, value and alpha are 0 for pixels
+    // no streamline went through (invalid vectors) or with weightSum < 0.5 as in integratePixel()
+    inline void fastLICPixel(float accumulated, int hits, float &outValue, float &outAlpha) const {
+        if (hits > 0 && weightSum_ >= 0.5f) {
+            outValue = accumulated / (float) hits;
+            outAlpha = 1.0f;
+        } else {
+            outValue = 0.0f;
+            outAlpha = 0.0f;
+        }
+    }
+
+    // Pyramid levels multi-scale LIC of numSteps long streamlines gets to use
+    static int multiScaleLevels(int numSteps) {
+        int levels = 0;
+        while (levels < FieldPyramid::kMaxLevels &&
+               (kMultiScaleNearSteps << levels) + (2 << levels) <= numSteps) {
+            levels++;
+        }
+        return levels;
+    }
+
+    // Integrates the streamline through pixel (x, y) into acc, returns the sum of weights (0 for pixels without
+    // a valid vector); adds the steps to counts, unless it's nullptr
+    template<bool UseWeightWindow, typename Acc>
+    inline float integrateStreamline(int x, int y, Acc &acc, LICStepCounts *counts) {
+        auto px0 = (float) x, py0 = (float) y;
+        float px, py, weight;
+        float weightSum = 0.0f;
+        int steps = 0, extrapolated = 0;
+
+        weight = UseWeightWindow ? weights_[0] : 1.0f;
+        if (!UseWeightWindow || weight != 0.0f) {
+            accumulate(acc, weight, px0, py0);
+            weightSum += weight;
+        }
+        float ux, uy;
+        bool valid_initial = sampleDirection(px0, py0, ux, uy);
+        float ux_initial = ux, uy_initial = uy;
+        float ux_last = ux_initial, uy_last = uy_initial;
+        bool use_last = false;
+
+        if (valid_initial && pyramid_) {
+            integrateMultiScale<UseWeightWindow>(px0, py0, ux_initial, uy_initial, +1.0f, forwardSteps_,
+                                                 acc, weightSum, steps, extrapolated);
+            integrateMultiScale<UseWeightWindow>(px0, py0, ux_initial, uy_initial, -1.0f, backwardSteps_,
+                                                 acc, weightSum, steps, extrapolated);
+        } else if (valid_initial && integrator_ != eIntegratorEuler) {
+            integrateRungeKutta<UseWeightWindow>(px0, py0, ux_initial, uy_initial, +1.0f, forwardSteps_,
+                                                 acc, weightSum, steps, extrapolated);
+            integrateRungeKutta<UseWeightWindow>(px0, py0, ux_initial, uy_initial, -1.0f, backwardSteps_,
+                                                 acc, weightSum, steps, extrapolated);
+        } else if (valid_initial) {
+            // integrate forward, as far as there are non-zero weights - zero weight steps only move
+            // the streamline, without sampling the noise
+            px = px0, py = py0;
+            for (int i = 0; i < forwardSteps_; i++) {
+                if (!use_last && !sampleDirection(px, py, ux, uy)) {
+                    // we're out of picture / out of area where vectors are defined,
+                    // so we will imagine that the vector field goes in the last known direction to infinity
+                    // (or stop there)
+                    if (stopAtBoundary_) break;
+                    use_last = true;
+                }
+                if (use_last) {
+                    ux = ux_last;
+                    uy = uy_last;
+                }
+
+                px += ux;
+                py += uy;
+                weight = UseWeightWindow ? weights_[i+1] : 1.0f;
+                if (!UseWeightWindow || weight != 0.0f) {
+                    accumulate(acc, weight, px, py);
+                    weightSum += weight;
+                    steps++;
+                    extrapolated += use_last;
+                }
+                ux_last = ux;
+                uy_last = uy;
+            }
+
+            // integrate backward
+            px = px0, py = py0;
+            ux_last = ux_initial, uy_last = uy_initial;
+            use_last = false;
+            for (int i = 0; i < backwardSteps_; i++) {
+                if (!use_last && !sampleDirection(px, py, ux, uy)) {
+                    // we're out of picture / out of area where vectors are defined,
+                    // so we will imagine that the vector field goes in the last known direction to infinity
+                    // (or stop there)
+                    if (stopAtBoundary_) break;
+                    use_last = true;
+                }
+                if (use_last) {
+                    ux = ux_last;
+                    uy = uy_last;
+                }
+
+                px -= ux;
+                py -= uy;
+                weight = UseWeightWindow ? weights_[-i-1] : 1.0f;
+                if (!UseWeightWindow || weight != 0.0f) {
+                    accumulate(acc, weight, px, py);
+                    weightSum += weight;
+                    steps++;
+                    extrapolated += use_last;
+                }
+                ux_last = ux;
+                uy_last = uy;
+            }
+        } else {
+            // we're starting at a null or NaN vector; no point in integrating,
+            // mask this pixel in output (whatever is in acc)
+            weightSum = 0.0f;
+        }
+
+        if (counts) {
+            counts->steps += steps;
+            counts->extrapolatedSteps += extrapolated;
+        }
+        return weightSum;
+    }
+
+    // integrates the noise along the streamline through pixel (x, y) - value and alpha are 0 for pixels without
+    // a valid vector; adds the work done to counts, unless it's nullptr
+    template<bool UseWeightWindow>
+    inline void integratePixel(int x, int y, float &outValue, float &outAlpha, LICStepCounts *counts = nullptr) {
+        NoiseAccumulator acc;
+        float weightSum = integrateStreamline<UseWeightWindow>(x, y, acc, counts);
+
+        outValue = acc.value / weightSum;
+        outAlpha = 1.0f;
+        if (weightSum < 0.5f) {
+            outValue = 0.0f;
+            outAlpha = 0.0f;
+        }
+
+        if (counts) {
+            counts->maskedPixels += outAlpha == 0.0f;
+        }
+    }
+
+    // Colour LIC - integrates the texture (set with setTexture()) along the streamline through pixel (x, y)
+    // into premultiplied RGBA, transparent black for pixels without a valid vector
+    template<bool UseWeightWindow, bool ModulateByNoise>
+    inline void integratePixelTexture(int x, int y, float *outRGBA, LICStepCounts *counts = nullptr) {
+        TextureAccumulator<ModulateByNoise> acc(texture_);
+        float weightSum = integrateStreamline<UseWeightWindow>(x, y, acc, counts);
+
+        bool masked = weightSum < 0.5f;
+        for (int c = 0; c < 4; c++) {
+            outRGBA[c] = masked ? 0.0f : acc.rgba[c] / weightSum;
+        }
+
+        if (counts) {
+            counts->maskedPixels += masked;
+        }
+    }
+
+    LICIntegrator()
+            : directionField_(nullptr), noiseTexture_(nullptr),
+              frequency(1), num_steps(15),
+              use_weight_window(false), weight_window_width(10), weight_window_offset(0),
+              weights_(nullptr), weightSum_(0.0f), forwardSteps_(0), backwardSteps_(0),
+              integrator_(eIntegratorEuler), bilinearVectors_(false), stopAtBoundary_(false), pyramid_(nullptr),
+              texture_(nullptr) {
+    }
+
+    void setDirectionField(const DirectionField *v) { directionField_ = v; }
+
+    void setNoiseTexture(const NoiseTexture *t) { noiseTexture_ = t; }
+
+    // Euler streamlines only, the noise texture must be set too
+    void setFieldPyramid(const FieldPyramid *p) { pyramid_ = p; }
+
+    // must have the direction field's bounds
+    void setTexture(const TextureField *t) { texture_ = t; }
+
+    void setNoiseFunction(const NoiseFunction &n) { noise = n; }
+
+    void setFrequency(float d) { frequency = d; }
+
+    void setNumSteps(int d) { num_steps = d; }
+
+    void setUseWeightWindow(bool x) { use_weight_window = x; }
+
+    void setWeightWindowWidth(int d) { weight_window_width = d; }
+
+    void setWeightWindowOffset(int d) { weight_window_offset = d; }
+
+    void setIntegrator(int d) { integrator_ = d; }
+
+    void setBilinearVectors(bool x) { bilinearVectors_ = x; }
+
+    void setStopAtBoundary(bool x) { stopAtBoundary_ = x; }
+
+    // everything but the inputs
+    void setParams(const LICParams &params) {
+        setNoiseFunction(NoiseFunction(params.noiseType, params.seed));
+        setFrequency(params.frequency);
+        setNumSteps(params.numSteps);
+        setIntegrator(params.integrator);
+        setBilinearVectors(params.vectorSampling == eVectorSamplingBilinear);
+        setStopAtBoundary(params.boundary == eBoundaryStop);
+        setUseWeightWindow(params.useWeightWindow);
+        setWeightWindowWidth(params.weightWindowWidth);
+        setWeightWindowOffset(params.weightWindowOffset);
+    }
+
+    void prepareWeights() {
+        weightSum_ = build_step_weights(weightTable_, num_steps, use_weight_window,
+                                        weight_window_width, weight_window_offset);
+        weights_ = weightTable_.data() + num_steps;
+        forwardSteps_ = weighted_steps(weightTable_, num_steps, +1);
+        backwardSteps_ = weighted_steps(weightTable_, num_steps, -1);
+    }
+
+    // Tiles are sized to have their direction field and noise footprint (tile + streamline reach on each side,
+    // ~12 bytes per pixel) fit into L2, assuming a conservative 256 kB per core. Rounded to a multiple of 8
+    // to fit the SIMD lanes.
+    int defaultTileSize() const {
+        const int footprint = (int) std::sqrt(256.0 * 1024.0 / 12.0);
+        return std::max(16, (footprint - 2 * num_steps) / 8 * 8);
+    }
+};
+
+// Float image in caller's memory: pixel (x, y) starts at data[(y - bounds.y1) * rowStride + (x - bounds.x1) * components].
+// Only the first channel of vector images is read, so an interleaved (x, y) buffer can be passed as two images
+// with components = 2, the Y one starting at data + 1. Output images are 1 (LIC value) or 4 (RGBA: grey value,
+// alpha masking pixels without a valid vector) components, with masked pixels transparent black.
+template<typename T>
+struct LICImageT {
+    T *data;
+    RectI bounds;
+    int components;
+    // in floats, not bytes; negative for buffers stored top row first
+    ptrdiff_t rowStride;
+
+    T *pixel(int x, int y) const {
+        return data + (y - bounds.y1) * rowStride + (ptrdiff_t) (x - bounds.x1) * components;
+    }
+};
+
+typedef LICImageT<float> LICImage;
+typedef LICImageT<const float> LICConstImage;
+
+// Pixel values of float and half float (uint16_t) images
+inline float to_float(float x) { return x; }
+
+inline float to_float(uint16_t x) { return halfToFloat(x); }
+
+inline void from_float(float x, float &dst) { dst = x; }
+
+inline void from_float(float x, uint16_t &dst) { dst = floatToHalf(x); }
+
+// Output pixel - RGBA is grey with validity mask in alpha, Alpha is just the value (masked pixels are 0)
+template<int Components, typename PIX>
+inline void store_pixel(PIX *dst, float value, float alpha) {
+    from_float(value, dst[0]); // = R or A
+    if (Components == 4) {
+        dst[1] = dst[0]; // = G
+        dst[2] = dst[0]; // = B
+        from_float(alpha, dst[3]); // = A
+    }
+}
+
+// Output pixel of colour LIC - premultiplied RGBA, or just its alpha
+template<int Components, typename PIX>
+inline void store_colour(PIX *dst, const float *rgba) {
+    if (Components == 4) {
+        for (int c = 0; c < 4; c++) from_float(rgba[c], dst[c]);
+    } else {
+        from_float(rgba[3], dst[0]);
+    }
+}
+
+// Packs channel srcChannel of row y of img into channel (0 for X, 1 for Y) of dst, the interleaved row
+// of a DirectionField (or MotionField) covering fieldBounds. Pixels outside the image repeat its edge.
+template<typename PIX>
+inline void pack_vector_channel(float *dst, const RectI &fieldBounds, int y, const LICImageT<const PIX> &img,
+                                int srcChannel, int channel) {
+    const RectI &ib = img.bounds;
+    const PIX *src = img.pixel(ib.x1, std::min(std::max(y, ib.y1), ib.y2 - 1)) + srcChannel;
+    for (int x = fieldBounds.x1; x < fieldBounds.x2; x++) {
+        int sx = std::min(std::max(x, ib.x1), ib.x2 - 1);
+        dst[2 * (x - fieldBounds.x1) + channel] = to_float(src[(ptrdiff_t) (sx - ib.x1) * img.components]);
+    }
+}
+
+// Packs row y of the X and Y vector images into dst, see pack_vector_channel(). X and Y can be two channels
+// of the same image (the plug-in's Vectors clip), that is read in one pass.
+template<typename PIX>
+inline void pack_vector_row(float *dst, const RectI &fieldBounds, int y, const LICImageT<const PIX> &vectorX,
+                            int xChannel, const LICImageT<const PIX> &vectorY, int yChannel) {
+    if (vectorX.data != vectorY.data) {
+        pack_vector_channel(dst, fieldBounds, y, vectorX, xChannel, 0);
+        pack_vector_channel(dst, fieldBounds, y, vectorY, yChannel, 1);
+        return;
+    }
+
+    const RectI &ib = vectorX.bounds;
+    const PIX *src = vectorX.pixel(ib.x1, std::min(std::max(y, ib.y1), ib.y2 - 1));
+    for (int x = fieldBounds.x1; x < fieldBounds.x2; x++, dst += 2) {
+        const PIX *pix = src + (ptrdiff_t) (std::min(std::max(x, ib.x1), ib.x2 - 1) - ib.x1) * vectorX.components;
+        dst[0] = to_float(pix[xChannel]);
+        dst[1] = to_float(pix[yChannel]);
+    }
+}
+
+// Packs row y of a 1 (Alpha), 3 (RGB) or 4 (RGBA) component texture image into dst, the premultiplied RGBA row
+// of a TextureField covering fieldBounds, clamping to the edges of the image as pack_vector_channel() does.
+// RGB textures are opaque, Alpha ones are grey with that alpha (premultiplied, like covering a white texture).
+template<typename PIX>
+inline void pack_texture_row(float *dst, const RectI &fieldBounds, int y, const LICImageT<const PIX> &img) {
+    const RectI &ib = img.bounds;
+    if (ib.isEmpty()) {
+        // no overlap with the texture at all
+        std::fill(dst, dst + 4 * (size_t) fieldBounds.width(), 0.0f);
+        return;
+    }
+
+    const PIX *src = img.pixel(ib.x1, std::min(std::max(y, ib.y1), ib.y2 - 1));
+    for (int x = fieldBounds.x1; x < fieldBounds.x2; x++, dst += 4) {
+        const PIX *pix = src + (ptrdiff_t) (std::min(std::max(x, ib.x1), ib.x2 - 1) - ib.x1) * img.components;
+        if (img.components == 1) {
+            dst[0] = dst[1] = dst[2] = dst[3] = to_float(pix[0]);
+        } else {
+            dst[0] = to_float(pix[0]);
+            dst[1] = to_float(pix[1]);
+            dst[2] = to_float(pix[2]);
+            dst[3] = img.components == 4 ? to_float(pix[3]) : 1.0f;
+        }
+    }
+}
+
+// Runs work on threads of the caller's choosing (same contract as OFX::MultiThread::Processor)
+class LICThreadPool {
+public:
+    virtual ~LICThreadPool() {}
+
+    virtual unsigned int numThreads() const = 0;
+
+    // calls fn(threadIndex, numThreads()) once on each of the threads, returns when all of them are done
+    virtual void run(const std::function<void(unsigned int threadIndex, unsigned int threadMax)> &fn) = 0;
+};
+
+// Thread pool starting std::threads for each run(); 0 threads means one per hardware thread
+class LICStdThreadPool : public LICThreadPool {
+public:
+    explicit LICStdThreadPool(unsigned int numThreads = 0);
+
+    unsigned int numThreads() const override { return numThreads_; }
+
+    void run(const std::function<void(unsigned int threadIndex, unsigned int threadMax)> &fn) override;
+
+private:
+    unsigned int numThreads_;
+};
+
+// Returns true when the render should stop; polled between tiles from all the threads
+typedef std::function<bool()> LICCancelCallback;
+
+// Render of a window in two steps, so that the same inputs can be rendered repeatedly (eg. benchmarks):
+// prepare() packs the vectors for the window and everything its streamlines reach - clamping to the edges
+// of the vector images - and bakes noise if asked to, render() integrates the window. Scratch buffers come
+// from the arena, if given, so that renderers of consecutive frames reuse them.
+class LICRenderer {
+public:
+    explicit LICRenderer(const LICParams &params, BufferArena *arena = nullptr);
+    ~LICRenderer();
+
+    void prepare(const LICConstImage &vectorX, const LICConstImage &vectorY, const RectI &window,
+                 LICThreadPool &pool);
+
+    // dst must cover the window; returns false if cancelled (dst is then partially rendered)
+    bool render(const LICImage &dst, LICThreadPool &pool, const LICCancelCallback &cancelled = nullptr);
+
+private:
+    LICParams params_;
+    BufferArena *arena_;
+    RectI window_;
+    DirectionField directionField_;
+    std::unique_ptr<NoiseTexture> noiseTexture_;
+    // contiguous copy of the noise for the SIMD kernel
+    ArenaBuffer noiseData_;
+    RectI noiseBounds_;
+    // multi-scale LIC
+    FieldPyramid pyramid_;
+    bool usePyramid_;
+};
+
+// LIC of the window of dst, prepare() and render() in one go; pool nullptr runs on LICStdThreadPool.
+// Throws std::invalid_argument for images it can't handle.
+bool licRender(const LICParams &params, const LICConstImage &vectorX, const LICConstImage &vectorY,
+               const LICImage &dst, const RectI &window, LICThreadPool *pool = nullptr,
+               const LICCancelCallback &cancelled = nullptr);
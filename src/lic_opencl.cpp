@@ -0,0 +1,358 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "lic_opencl.h"
+
+#ifdef LIC_HAVE_OPENCL
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+namespace {
+
+// One work item per output pixel. Built with -DLIC_HALF for half float images, which only needs
+// vload_half/vstore_half from core OpenCL, not the cl_khr_fp16 extension.
+const char *kKernelSource = R"CLC(
+#ifdef LIC_HALF
+typedef half PIX;
+#define LOAD(p, i) vload_half((i), (p))
+#define STORE(v, p, i) vstore_half((v), (i), (p))
+#else
+typedef float PIX;
+#define LOAD(p, i) ((p)[i])
+#define STORE(v, p, i) ((p)[i] = (v))
+#endif
+
+typedef struct {
+    __global const PIX *data;
+    int4 bounds; // x1, y1, x2, y2
+    int components;
+    int rowStride;
+    int channel;
+} Image;
+
+// the vector channel, pixels outside of the image have the clamped edge value
+inline float loadChannel(Image img, int x, int y) {
+    x = clamp(x, img.bounds.x, img.bounds.z - 1);
+    y = clamp(y, img.bounds.y, img.bounds.w - 1);
+    return LOAD(img.data, (y - img.bounds.y) * img.rowStride + (x - img.bounds.x) * img.components + img.channel);
+}
+
+// same as DirectionField::normalizeRow() followed by DirectionField::at()
+inline int loadDirection(Image vectorX, Image vectorY, int x, int y, float *ux, float *uy) {
+    float dx = loadChannel(vectorX, x, y);
+    float dy = loadChannel(vectorY, x, y);
+    float umag = sqrt(dx * dx + dy * dy);
+    dx /= umag;
+    dy /= umag;
+
+    if (isfinite(dx) && isfinite(dy) && (dx != 0.0f || dy != 0.0f)) {
+        *ux = dx;
+        *uy = dy;
+        return 1;
+    }
+    *ux = 0.0f;
+    *uy = 0.0f;
+    return 0;
+}
+
+// same as LICProcessorBase::sampleDirection() with nearest neighbour lookup
+inline int sampleDirection(Image vectorX, Image vectorY, float px, float py, float *ux, float *uy) {
+    return loadDirection(vectorX, vectorY, (int) px, (int) py, ux, uy);
+}
+
+// same as DirectionField::sampleBilinear()
+inline int sampleDirectionBilinear(Image vectorX, Image vectorY, float px, float py, float *ux, float *uy) {
+    if (!sampleDirection(vectorX, vectorY, px, py, ux, uy)) return 0;
+
+    float fx = floor(px), fy = floor(py);
+    float ax = px - fx, ay = py - fy;
+    if (ax == 0.0f && ay == 0.0f) return 1;
+
+    int x = (int) fx, y = (int) fy;
+    float t00x, t00y, t01x, t01y, t10x, t10y, t11x, t11y;
+    loadDirection(vectorX, vectorY, x, y, &t00x, &t00y);
+    loadDirection(vectorX, vectorY, x + 1, y, &t01x, &t01y);
+    loadDirection(vectorX, vectorY, x, y + 1, &t10x, &t10y);
+    loadDirection(vectorX, vectorY, x + 1, y + 1, &t11x, &t11y);
+
+    float topX = t00x + ax * (t01x - t00x);
+    float topY = t00y + ax * (t01y - t00y);
+    float bottomX = t10x + ax * (t11x - t10x);
+    float bottomY = t10y + ax * (t11y - t10y);
+    float vx = topX + ay * (bottomX - topX);
+    float vy = topY + ay * (bottomY - topY);
+
+    float vmag = sqrt(vx * vx + vy * vy);
+    if (vmag > 0.0f) {
+        *ux = vx / vmag;
+        *uy = vy / vmag;
+    }
+    return 1;
+}
+
+// same as NoiseTexture::sample()
+inline float sampleNoise(__global const float *noise, int4 noiseBounds, float px, float py) {
+    float fx = floor(px), fy = floor(py);
+    int stride = noiseBounds.z - noiseBounds.x;
+    __global const float *t = noise + ((int) fy - noiseBounds.y) * stride + ((int) fx - noiseBounds.x);
+
+    float ax = px - fx, ay = py - fy;
+    float top = t[0] + ax * (t[1] - t[0]);
+    float bottom = t[stride] + ax * (t[stride + 1] - t[stride]);
+    return top + ay * (bottom - top);
+}
+
+// one direction of the integration, sign = +1 forward, -1 backward, for steps up to the last non-zero weight;
+// adds the weighted noise samples to acc and their weights to weightSum
+inline void integrate(Image vectorX, Image vectorY, __global const float *noise, int4 noiseBounds,
+                      __constant float *weights, int numSteps, int steps, int bilinearVectors, int stopAtBoundary,
+                      int sign, float px, float py, float ux_last, float uy_last, float *acc, float *weightSum) {
+    int use_last = 0;
+    float ux, uy;
+
+    for (int i = 0; i < steps; i++) {
+        if (!use_last && !(bilinearVectors ? sampleDirectionBilinear(vectorX, vectorY, px, py, &ux, &uy)
+                                           : sampleDirection(vectorX, vectorY, px, py, &ux, &uy))) {
+            // out of area where vectors are defined, continue in the last known direction (or stop there)
+            if (stopAtBoundary) break;
+            use_last = 1;
+        }
+        if (use_last) {
+            ux = ux_last;
+            uy = uy_last;
+        }
+
+        px += (float) sign * ux;
+        py += (float) sign * uy;
+        float weight = weights[numSteps + sign * (i + 1)];
+        if (weight != 0.0f) {
+            *acc += weight * sampleNoise(noise, noiseBounds, px, py);
+            *weightSum += weight;
+        }
+        ux_last = ux;
+        uy_last = uy;
+    }
+}
+
+__kernel void lic(__global const PIX *vectorXData, int4 vectorXBounds, int vectorXComponents, int vectorXRowStride,
+                  int vectorXChannel,
+                  __global const PIX *vectorYData, int4 vectorYBounds, int vectorYComponents, int vectorYRowStride,
+                  int vectorYChannel,
+                  __global PIX *dst, int4 dstBounds, int dstComponents, int dstRowStride,
+                  int4 renderWindow,
+                  __global const float *noise, int4 noiseBounds,
+                  __constant float *weights, float weightSum, int numSteps, int forwardSteps, int backwardSteps,
+                  int bilinearVectors, int stopAtBoundary) {
+    int x = renderWindow.x + (int) get_global_id(0);
+    int y = renderWindow.y + (int) get_global_id(1);
+    if (x >= renderWindow.z || y >= renderWindow.w) return;
+
+    Image vectorX = {vectorXData, vectorXBounds, vectorXComponents, vectorXRowStride, vectorXChannel};
+    Image vectorY = {vectorYData, vectorYBounds, vectorYComponents, vectorYRowStride, vectorYChannel};
+    float px0 = (float) x, py0 = (float) y;
+
+    // weights are summed in the same order as on the CPU, so without stopAtBoundary streamlineWeightSum
+    // is exactly weightSum
+    float streamlineWeightSum = weights[numSteps];
+    float acc = streamlineWeightSum != 0.0f ? streamlineWeightSum * sampleNoise(noise, noiseBounds, px0, py0) : 0.0f;
+    float ux_initial, uy_initial;
+    int valid = sampleDirection(vectorX, vectorY, px0, py0, &ux_initial, &uy_initial) && weightSum >= 0.5f;
+
+    if (valid) {
+        integrate(vectorX, vectorY, noise, noiseBounds, weights, numSteps, forwardSteps, bilinearVectors,
+                  stopAtBoundary, +1, px0, py0, ux_initial, uy_initial, &acc, &streamlineWeightSum);
+        integrate(vectorX, vectorY, noise, noiseBounds, weights, numSteps, backwardSteps, bilinearVectors,
+                  stopAtBoundary, -1, px0, py0, ux_initial, uy_initial, &acc, &streamlineWeightSum);
+        valid = streamlineWeightSum >= 0.5f;
+    }
+
+    // masked pixels get transparent black, as in LICProcessor
+    float value = valid ? acc / streamlineWeightSum : 0.0f;
+    float alpha = valid ? 1.0f : 0.0f;
+
+    __global PIX *d = dst + (y - dstBounds.y) * dstRowStride + (x - dstBounds.x) * dstComponents;
+    STORE(value, d, 0); // = R or A
+    if (dstComponents == 4) {
+        STORE(value, d, 1); // = G
+        STORE(value, d, 2); // = B
+        STORE(alpha, d, 3); // = A
+    }
+}
+)CLC";
+
+struct CachedProgram {
+    cl_context context;
+    cl_device_id device;
+    bool half;
+    cl_program program;
+};
+
+// Programs are built once per context, device and pixel type and kept for the lifetime of the plugin.
+// The context is retained, so that its handle can't be reused for a different one.
+std::mutex programCacheMutex;
+std::vector<CachedProgram> programCache;
+
+bool checkError(cl_int err, const char *what) {
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "licOpenCL: %s failed with error %d\n", what, err);
+        return false;
+    }
+    return true;
+}
+
+cl_program getProgram(cl_context context, cl_device_id device, bool half) {
+    std::lock_guard<std::mutex> lock(programCacheMutex);
+
+    for (const auto &cached: programCache) {
+        if (cached.context == context && cached.device == device && cached.half == half) {
+            return cached.program;
+        }
+    }
+
+    cl_int err;
+    cl_program program = clCreateProgramWithSource(context, 1, &kKernelSource, nullptr, &err);
+    if (!checkError(err, "clCreateProgramWithSource")) return nullptr;
+
+    err = clBuildProgram(program, 1, &device, half ? "-DLIC_HALF" : "", nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+        std::string log(logSize, '\0');
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], nullptr);
+        fprintf(stderr, "licOpenCL: clBuildProgram failed with error %d:\n%s\n", err, log.c_str());
+        clReleaseProgram(program);
+        return nullptr;
+    }
+
+    clRetainContext(context);
+    programCache.push_back({context, device, half, program});
+    return program;
+}
+
+// OpenCL objects of one render; releasing them is deferred by OpenCL until the kernel is done with them
+struct RenderResources {
+    cl_kernel kernel = nullptr;
+    cl_mem noise = nullptr;
+    cl_mem weights = nullptr;
+
+    ~RenderResources() {
+        if (kernel) clReleaseKernel(kernel);
+        if (noise) clReleaseMemObject(noise);
+        if (weights) clReleaseMemObject(weights);
+    }
+};
+
+cl_int4 toInt4(const RectI &r) {
+    cl_int4 v;
+    v.s[0] = r.x1;
+    v.s[1] = r.y1;
+    v.s[2] = r.x2;
+    v.s[3] = r.y2;
+    return v;
+}
+
+template<typename T>
+cl_int setArg(cl_kernel kernel, cl_uint &index, const T &value) {
+    return clSetKernelArg(kernel, index++, sizeof(T), &value);
+}
+
+cl_int setImageArgs(cl_kernel kernel, cl_uint &index, const OpenCLImage &img) {
+    auto buffer = (cl_mem) img.buffer;
+    cl_int err = setArg(kernel, index, buffer);
+    if (err == CL_SUCCESS) err = setArg(kernel, index, toInt4(img.bounds));
+    if (err == CL_SUCCESS) err = setArg(kernel, index, (cl_int) img.components);
+    if (err == CL_SUCCESS) err = setArg(kernel, index, (cl_int) img.rowStride);
+    return err;
+}
+
+cl_int setVectorImageArgs(cl_kernel kernel, cl_uint &index, const OpenCLImage &img) {
+    cl_int err = setImageArgs(kernel, index, img);
+    if (err == CL_SUCCESS) err = setArg(kernel, index, (cl_int) img.channel);
+    return err;
+}
+
+}
+
+bool licOpenCL(void *commandQueue, const OpenCLKernelArgs &args) {
+    auto queue = (cl_command_queue) commandQueue;
+    cl_context context;
+    cl_device_id device;
+    if (!checkError(clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(context), &context, nullptr),
+                    "clGetCommandQueueInfo") ||
+        !checkError(clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, nullptr),
+                    "clGetCommandQueueInfo")) {
+        return false;
+    }
+
+    cl_program program = getProgram(context, device, args.half);
+    if (!program) return false;
+
+    // setting kernel arguments is not thread safe, so each render gets its own kernel object
+    RenderResources res;
+    cl_int err;
+    res.kernel = clCreateKernel(program, "lic", &err);
+    if (!checkError(err, "clCreateKernel")) return false;
+
+    size_t noiseSize = sizeof(float) * (size_t) args.noiseBounds.width() * (size_t) args.noiseBounds.height();
+    res.noise = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, noiseSize,
+                               (void *) args.noise, &err);
+    if (!checkError(err, "clCreateBuffer")) return false;
+
+    size_t weightsSize = sizeof(float) * (size_t) (2 * args.numSteps + 1);
+    res.weights = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, weightsSize,
+                                 (void *) (args.weights - args.numSteps), &err);
+    if (!checkError(err, "clCreateBuffer")) return false;
+
+    cl_uint index = 0;
+    err = setVectorImageArgs(res.kernel, index, args.vectorX);
+    if (err == CL_SUCCESS) err = setVectorImageArgs(res.kernel, index, args.vectorY);
+    if (err == CL_SUCCESS) err = setImageArgs(res.kernel, index, args.dst);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, toInt4(args.renderWindow));
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, res.noise);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, toInt4(args.noiseBounds));
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, res.weights);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_float) args.weightSum);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_int) args.numSteps);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_int) args.forwardSteps);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_int) args.backwardSteps);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_int) args.bilinearVectors);
+    if (err == CL_SUCCESS) err = setArg(res.kernel, index, (cl_int) args.stopAtBoundary);
+    if (!checkError(err, "clSetKernelArg")) return false;
+
+    // no clFinish, the host synchronizes its queue
+    size_t globalSize[2] = {(size_t) args.renderWindow.width(), (size_t) args.renderWindow.height()};
+    err = clEnqueueNDRangeKernel(queue, res.kernel, 2, nullptr, globalSize, nullptr, 0, nullptr, nullptr);
+    return checkError(err, "clEnqueueNDRangeKernel");
+}
+
+#endif
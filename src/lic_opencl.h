@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "rect.h"
+
+// LIC on the GPU through the OpenFX OpenCL render extension - the images are OpenCL buffers (cl_mem)
+// owned by the host, and the work is enqueued on the host's command queue.
+//
+// The kernel does the same integration as LICProcessor with baked noise: vectors are read straight from
+// the host's images and normalized on the fly, noise is a copy of the baked texture uploaded for each render.
+
+struct OpenCLImage {
+    // cl_mem buffer with the pixels of bounds, row by row
+    void *buffer;
+    RectI bounds;
+    int components;
+    // elements (not pixels) between the starts of two consecutive rows
+    int rowStride;
+    // channel the vectors are read from, unused for the output
+    int channel;
+};
+
+struct OpenCLKernelArgs {
+    OpenCLImage vectorX, vectorY, dst;
+    // all three images are half float instead of float
+    bool half;
+    RectI renderWindow;
+    // contiguous copy of the baked noise texture covering noiseBounds
+    const float *noise;
+    RectI noiseBounds;
+    int numSteps;
+    // step weights indexed from -numSteps to +numSteps, ie. points to the middle of the table
+    const float *weights;
+    float weightSum;
+    // steps up to the last non-zero weight forward and backward, see weighted_steps()
+    int forwardSteps, backwardSteps;
+    // bilinear instead of nearest neighbour direction lookups
+    bool bilinearVectors;
+    // end streamlines where the valid vectors end, see BoundaryEnum
+    bool stopAtBoundary;
+};
+
+// Enqueues LIC of args.renderWindow on the cl_command_queue; returns false (and reports the reason on stderr)
+// if some OpenCL call failed
+bool licOpenCL(void *commandQueue, const OpenCLKernelArgs &args);
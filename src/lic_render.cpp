@@ -0,0 +1,449 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Command line LIC of EXR sequences, for render nodes without a compositing host:
+//
+//   lic_render [options] INPUT OUTPUT
+//
+// INPUT and OUTPUT are paths with the frame number as a run of '#' (zero padded to its length) or %d / %04d.
+// X and Y vectors are read from channels of the input (R and G by default), the output has the same data
+// window with RGBA or A channels. Rendering uses the same integrator as the plug-in's Standard kernel
+// (see lic_core.h), with the same coordinate system as hosts use for EXRs (y up, flipped within
+// the display window), so frames match what the plug-in renders. Step counts are in pixels of the file.
+//
+// Frames go through a pipeline: a reader thread reads ahead, the render uses all the other threads, and
+// a writer thread writes finished frames, so that disk I/O overlaps with rendering. --shard INDEX/COUNT
+// renders only the INDEX-th (from 0) of COUNT contiguous parts of the frame range, for splitting a sequence
+// across processes or farm nodes.
+
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "half_float.h"
+#include "lic_core.h"
+#include "lic_simd.h"
+
+namespace {
+
+// frames being read ahead / waiting to be written, each holds the vectors and the output of a whole frame
+const size_t kReadAhead = 2;
+const size_t kWriteBehind = 2;
+
+struct Options {
+    std::string input, output;
+    std::string xChannel = "R", yChannel = "G";
+    int firstFrame = 1, lastFrame = 1;
+    int shardIndex = 0, shardCount = 1;
+    LICParams params;
+    // weight window offset grows by this many steps per frame, for animated flow
+    int offsetPerFrame = 0;
+    bool alphaOutput = false;
+    bool halfOutput = false;
+    unsigned int threads = 0;
+};
+
+struct Frame {
+    int number;
+    Imath::Box2i displayWindow, dataWindow;
+    float pixelAspectRatio;
+    // interleaved X, Y vectors of the data window, in file row order
+    std::vector<float> vectors;
+    // 1 or 4 components per pixel, in file row order
+    std::vector<float> lic;
+};
+
+// Fixed capacity queue between two stages of the pipeline
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+    // waits for free space; returns false if the queue got closed meanwhile
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // waits for an item; returns false once the queue is closed and empty
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    // no more pushes; items already queued can still be popped
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_, notFull_;
+};
+
+// Replaces the frame number placeholder of the pattern, see the usage above
+std::string framePath(const std::string &pattern, int frame) {
+    size_t hash = pattern.find('#');
+    if (hash != std::string::npos) {
+        size_t end = pattern.find_first_not_of('#', hash);
+        int width = (int) ((end == std::string::npos ? pattern.size() : end) - hash);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%0*d", width, frame);
+        return pattern.substr(0, hash) + buf + (end == std::string::npos ? "" : pattern.substr(end));
+    }
+
+    size_t percent = pattern.find('%');
+    if (percent != std::string::npos) {
+        size_t end = percent + 1;
+        while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') end++;
+        if (end < pattern.size() && pattern[end] == 'd') {
+            int width = std::atoi(pattern.substr(percent + 1, end - percent - 1).c_str());
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%0*d", width, frame);
+            return pattern.substr(0, percent) + buf + pattern.substr(end + 1);
+        }
+    }
+    return pattern;
+}
+
+bool hasFramePlaceholder(const std::string &pattern) {
+    return framePath(pattern, 0) != framePath(pattern, 1);
+}
+
+// LIC coordinates of a file row, hosts put y = 0 at the bottom of the display window
+int licY(const Frame &frame, int fileY) {
+    return frame.displayWindow.min.y + frame.displayWindow.max.y - fileY;
+}
+
+// Rows of a buffer in file order seen in LIC coordinates - the first LIC row is the last file row
+template<typename T>
+LICImageT<T> licImage(const Frame &frame, T *data, int components) {
+    int width = frame.dataWindow.max.x - frame.dataWindow.min.x + 1;
+    int height = frame.dataWindow.max.y - frame.dataWindow.min.y + 1;
+    ptrdiff_t rowStride = (ptrdiff_t) width * components;
+    RectI bounds = {frame.dataWindow.min.x, licY(frame, frame.dataWindow.max.y),
+                    frame.dataWindow.max.x + 1, licY(frame, frame.dataWindow.min.y) + 1};
+    return {data + (height - 1) * rowStride, bounds, components, -rowStride};
+}
+
+std::unique_ptr<Frame> readFrame(const Options &opt, int number) {
+    std::string path = framePath(opt.input, number);
+    Imf::InputFile file(path.c_str());
+    const Imf::Header &header = file.header();
+
+    for (const std::string &channel: {opt.xChannel, opt.yChannel}) {
+        if (!header.channels().findChannel(channel.c_str())) {
+            throw std::runtime_error(path + " has no channel " + channel);
+        }
+    }
+
+    std::unique_ptr<Frame> frame(new Frame);
+    frame->number = number;
+    frame->displayWindow = header.displayWindow();
+    frame->dataWindow = header.dataWindow();
+    frame->pixelAspectRatio = header.pixelAspectRatio();
+
+    const Imath::Box2i &dw = frame->dataWindow;
+    size_t width = (size_t) (dw.max.x - dw.min.x + 1), height = (size_t) (dw.max.y - dw.min.y + 1);
+    frame->vectors.resize(2 * width * height);
+
+    // channels of other types are converted by the library
+    Imf::FrameBuffer frameBuffer;
+    size_t xStride = 2 * sizeof(float), yStride = xStride * width;
+    frameBuffer.insert(opt.xChannel.c_str(),
+                       Imf::Slice::Make(Imf::FLOAT, frame->vectors.data(), dw, xStride, yStride));
+    frameBuffer.insert(opt.yChannel.c_str(),
+                       Imf::Slice::Make(Imf::FLOAT, frame->vectors.data() + 1, dw, xStride, yStride));
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+    return frame;
+}
+
+// scratch buffers of the render come from the arena, so that frames of the same size don't allocate them again
+void renderFrame(const Options &opt, Frame &frame, LICThreadPool &pool, BufferArena &arena) {
+    LICParams params = opt.params;
+    params.weightWindowOffset += opt.offsetPerFrame * frame.number;
+
+    int components = opt.alphaOutput ? 1 : 4;
+    frame.lic.resize(frame.vectors.size() / 2 * components);
+
+    LICConstImage vectorX = licImage<const float>(frame, frame.vectors.data(), 2);
+    LICConstImage vectorY = vectorX;
+    vectorY.data += 1;
+    LICImage dst = licImage<float>(frame, frame.lic.data(), components);
+
+    LICRenderer renderer(params, &arena);
+    renderer.prepare(vectorX, vectorY, dst.bounds, pool);
+    renderer.render(dst, pool);
+
+    // vectors are not needed anymore, don't keep them around while the frame waits for the writer
+    std::vector<float>().swap(frame.vectors);
+}
+
+void writeFrame(const Options &opt, const Frame &frame) {
+    std::string path = framePath(opt.output, frame.number);
+    const Imath::Box2i &dw = frame.dataWindow;
+    size_t width = (size_t) (dw.max.x - dw.min.x + 1), height = (size_t) (dw.max.y - dw.min.y + 1);
+    int components = opt.alphaOutput ? 1 : 4;
+    const char *channels[4] = {"R", "G", "B", "A"};
+    const char **names = opt.alphaOutput ? channels + 3 : channels;
+
+    Imf::PixelType type = opt.halfOutput ? Imf::HALF : Imf::FLOAT;
+    Imf::Header header(frame.displayWindow, dw, frame.pixelAspectRatio);
+    header.compression() = Imf::ZIP_COMPRESSION;
+    for (int c = 0; c < components; c++) {
+        header.channels().insert(names[c], Imf::Channel(type));
+    }
+
+    std::vector<uint16_t> halfData;
+    const char *data = (const char *) frame.lic.data();
+    size_t pixelBytes = sizeof(float) * components;
+    if (opt.halfOutput) {
+        halfData.resize(frame.lic.size());
+        for (size_t i = 0; i < halfData.size(); i++) {
+            halfData[i] = floatToHalf(frame.lic[i]);
+        }
+        data = (const char *) halfData.data();
+        pixelBytes = sizeof(uint16_t) * components;
+    }
+
+    Imf::FrameBuffer frameBuffer;
+    for (int c = 0; c < components; c++) {
+        frameBuffer.insert(names[c], Imf::Slice::Make(type, data + pixelBytes / components * c, dw,
+                                                      pixelBytes, pixelBytes * width));
+    }
+
+    Imf::OutputFile file(path.c_str(), header);
+    file.setFrameBuffer(frameBuffer);
+    file.writePixels((int) height);
+}
+
+bool parseChoice(const std::string &s, std::initializer_list<const char *> names, int &value) {
+    int i = 0;
+    for (const char *name: names) {
+        if (s == name) {
+            value = i;
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+bool parseRange(const std::string &s, int &first, int &last) {
+    if (sscanf(s.c_str(), "%d-%d", &first, &last) == 2) return first <= last;
+    if (sscanf(s.c_str(), "%d", &first) == 1) {
+        last = first;
+        return true;
+    }
+    return false;
+}
+
+void usage() {
+    fprintf(stderr, "usage: lic_render [--frames FIRST-LAST] [--shard INDEX/COUNT] [--x-channel R] [--y-channel G]\n"
+                    "                  [--frequency 0.2] [--noise simplex|value|white] [--seed N]\n"
+                    "                  [--num-steps 15] [--integrator euler|rk2|rk4|adaptive]\n"
+                    "                  [--vector-sampling nearest|bilinear] [--boundary continue|stop]\n"
+                    "                  [--weight-window WIDTH] [--weight-window-offset STEPS] [--offset-per-frame STEPS]\n"
+                    "                  [--bake-noise] [--simd] [--fast-lic] [--multi-scale]\n"
+                    "                  [--output rgba|alpha] [--half] [--threads N]\n"
+                    "                  INPUT OUTPUT\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--frames" && hasValue) {
+            ok = parseRange(argv[++i], opt.firstFrame, opt.lastFrame);
+        } else if (arg == "--shard" && hasValue) {
+            ok = sscanf(argv[++i], "%d/%d", &opt.shardIndex, &opt.shardCount) == 2 &&
+                 opt.shardCount >= 1 && opt.shardIndex >= 0 && opt.shardIndex < opt.shardCount;
+        } else if (arg == "--x-channel" && hasValue) {
+            opt.xChannel = argv[++i];
+        } else if (arg == "--y-channel" && hasValue) {
+            opt.yChannel = argv[++i];
+        } else if (arg == "--frequency" && hasValue) {
+            opt.params.frequency = (float) std::atof(argv[++i]);
+            ok = opt.params.frequency > 0.0f;
+        } else if (arg == "--noise" && hasValue) {
+            ok = parseChoice(argv[++i], {"simplex", "value", "white"}, opt.params.noiseType);
+        } else if (arg == "--seed" && hasValue) {
+            opt.params.seed = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--num-steps" && hasValue) {
+            opt.params.numSteps = std::atoi(argv[++i]);
+            ok = opt.params.numSteps >= 1;
+        } else if (arg == "--integrator" && hasValue) {
+            ok = parseChoice(argv[++i], {"euler", "rk2", "rk4", "adaptive"}, opt.params.integrator);
+        } else if (arg == "--vector-sampling" && hasValue) {
+            ok = parseChoice(argv[++i], {"nearest", "bilinear"}, opt.params.vectorSampling);
+        } else if (arg == "--boundary" && hasValue) {
+            ok = parseChoice(argv[++i], {"continue", "stop"}, opt.params.boundary);
+        } else if (arg == "--weight-window" && hasValue) {
+            opt.params.useWeightWindow = true;
+            opt.params.weightWindowWidth = std::atoi(argv[++i]);
+            ok = opt.params.weightWindowWidth >= 1;
+        } else if (arg == "--weight-window-offset" && hasValue) {
+            opt.params.weightWindowOffset = std::atoi(argv[++i]);
+        } else if (arg == "--offset-per-frame" && hasValue) {
+            opt.offsetPerFrame = std::atoi(argv[++i]);
+        } else if (arg == "--bake-noise") {
+            opt.params.bakeNoise = true;
+        } else if (arg == "--simd") {
+            opt.params.useSimd = true;
+        } else if (arg == "--fast-lic") {
+            opt.params.fastLic = true;
+        } else if (arg == "--multi-scale") {
+            opt.params.multiScale = true;
+        } else if (arg == "--output" && hasValue) {
+            int output;
+            ok = parseChoice(argv[++i], {"rgba", "alpha"}, output);
+            opt.alphaOutput = output == 1;
+        } else if (arg == "--half") {
+            opt.halfOutput = true;
+        } else if (arg == "--threads" && hasValue) {
+            opt.threads = (unsigned int) std::max(0, std::atoi(argv[++i]));
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            ok = false;
+        } else {
+            paths.push_back(arg);
+        }
+
+        if (!ok) {
+            usage();
+            return 2;
+        }
+    }
+
+    if (paths.size() != 2) {
+        usage();
+        return 2;
+    }
+    opt.input = paths[0];
+    opt.output = paths[1];
+    if (opt.firstFrame != opt.lastFrame && (!hasFramePlaceholder(opt.input) || !hasFramePlaceholder(opt.output))) {
+        fprintf(stderr, "lic_render: INPUT and OUTPUT need a frame number placeholder for a frame range\n");
+        return 2;
+    }
+
+    // this shard's contiguous part of the range
+    long long numFrames = (long long) opt.lastFrame - opt.firstFrame + 1;
+    int first = opt.firstFrame + (int) (numFrames * opt.shardIndex / opt.shardCount);
+    int last = opt.firstFrame + (int) (numFrames * (opt.shardIndex + 1) / opt.shardCount) - 1;
+
+    // reader and writer threads mostly wait on the disk, the render gets all the cores
+    LICStdThreadPool pool(opt.threads);
+    BufferArena arena;
+    BoundedQueue<std::unique_ptr<Frame>> toRender(kReadAhead), toWrite(kWriteBehind);
+    std::atomic<bool> failed(false);
+
+    std::thread reader([&]() {
+        for (int number = first; number <= last && !failed; number++) {
+            std::unique_ptr<Frame> frame;
+            try {
+                frame = readFrame(opt, number);
+            } catch (const std::exception &e) {
+                fprintf(stderr, "lic_render: cannot read frame %d: %s\n", number, e.what());
+                failed = true;
+                break;
+            }
+            if (!toRender.push(std::move(frame))) break;
+        }
+        toRender.close();
+    });
+
+    std::thread writer([&]() {
+        std::unique_ptr<Frame> frame;
+        while (toWrite.pop(frame)) {
+            if (failed) continue;
+            try {
+                writeFrame(opt, *frame);
+            } catch (const std::exception &e) {
+                fprintf(stderr, "lic_render: cannot write frame %d: %s\n", frame->number, e.what());
+                failed = true;
+                // let the reader stop early
+                toRender.close();
+            }
+        }
+    });
+
+    std::unique_ptr<Frame> frame;
+    while (!failed && toRender.pop(frame)) {
+        auto t0 = std::chrono::steady_clock::now();
+        try {
+            renderFrame(opt, *frame, pool, arena);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "lic_render: cannot render frame %d: %s\n", frame->number, e.what());
+            failed = true;
+            break;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        printf("lic_render: frame %d rendered in %.1f ms\n", frame->number,
+               std::chrono::duration<double, std::milli>(t1 - t0).count());
+        fflush(stdout);
+
+        if (!toWrite.push(std::move(frame))) break;
+    }
+    toRender.close();
+    toWrite.close();
+    reader.join();
+    writer.join();
+
+    return failed ? 1 : 0;
+}
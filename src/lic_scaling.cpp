@@ -0,0 +1,392 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Scaling benchmark of the LIC kernels over thread counts, resolutions and number of steps, no OFX host needed:
+//
+//   lic_scaling [--threads 1,2,4,8] [--sizes 1920x1080,3840x2160,7680x4320] [--steps 5,15,50]
+//               [--kernels reference,simd,fastlic,gpu] [--reps 3]
+//
+// Every case renders the vortex field of lic_bench through LICRenderer (see lic_core.h) on LICStdThreadPool,
+// best of --reps, and prints a CSV line to stdout. Threads default to powers of two up to 128 and the number
+// of hardware threads, whichever is less. Speedup and parallel efficiency (speedup / threads) are relative to
+// the single threaded run of the same kernel, size and steps, so they are empty if --threads doesn't have 1.
+// Every line has the number of hardware threads of the machine, so that a CSV shows whether it measured scaling
+// (thread counts above it only measure oversubscription).
+// Packing the vectors and baking the noise (LICRenderer::prepare()) are not timed.
+//
+// The "gpu" kernel is there when built with LIC_HAVE_OPENCL and an OpenCL device is found; its timing
+// includes the upload of the noise and waiting for the queue, as in the plug-in, its threads column is 0.
+//
+// Runs measured with this tool are in docs/baselines (single threaded only, so far).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lic_core.h"
+#include "lic_simd.h"
+
+#ifdef LIC_HAVE_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include "lic_opencl.h"
+#include "noise_texture.h"
+#include "step_weights.h"
+#endif
+
+namespace {
+
+const float kFrequency = 0.2f;
+
+enum KernelEnum {
+    eKernelReference,
+    eKernelSIMD,
+    eKernelFastLIC,
+    eKernelGPU,
+};
+
+const char *const kKernelNames[] = {"reference", "simd", "fastlic", "gpu"};
+
+struct Timing {
+    double seconds;
+    bool ok;
+};
+
+template<typename Fn>
+Timing bestOf(int reps, Fn fn) {
+    Timing best = {1e30, true};
+    for (int r = 0; r < reps && best.ok; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        best.ok = fn();
+        auto t1 = std::chrono::steady_clock::now();
+        best.seconds = std::min(best.seconds, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+#ifdef LIC_HAVE_OPENCL
+// Context and queue on the first OpenCL device, preferring GPUs
+class OpenCLDevice {
+public:
+    ~OpenCLDevice() {
+        if (queue_) clReleaseCommandQueue(queue_);
+        if (context_) clReleaseContext(context_);
+    }
+
+    bool init() {
+        cl_uint numPlatforms = 0;
+        if (clGetPlatformIDs(0, nullptr, &numPlatforms) != CL_SUCCESS || numPlatforms == 0) return false;
+        std::vector<cl_platform_id> platforms(numPlatforms);
+        clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+
+        cl_device_id device = nullptr;
+        for (cl_device_type type: {(cl_device_type) CL_DEVICE_TYPE_GPU, (cl_device_type) CL_DEVICE_TYPE_ALL}) {
+            for (cl_platform_id platform: platforms) {
+                if (!device && clGetDeviceIDs(platform, type, 1, &device, nullptr) != CL_SUCCESS) {
+                    device = nullptr;
+                }
+            }
+        }
+        if (!device) return false;
+
+        char name[256] = {};
+        clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, nullptr);
+        name_ = name;
+
+        cl_int err;
+        context_ = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+        if (err != CL_SUCCESS) return false;
+        queue_ = clCreateCommandQueue(context_, device, 0, &err);
+        return err == CL_SUCCESS;
+    }
+
+    cl_context context() const { return context_; }
+
+    cl_command_queue queue() const { return queue_; }
+
+    const std::string &name() const { return name_; }
+
+private:
+    cl_context context_ = nullptr;
+    cl_command_queue queue_ = nullptr;
+    std::string name_;
+};
+
+// Renders the window with the OpenCL kernel, with the same settings as the CPU kernels
+class OpenCLRender {
+public:
+    OpenCLRender(const OpenCLDevice &device, const std::vector<float> &vectors, const RectI &window, int numSteps)
+            : device_(device), window_(window), numSteps_(numSteps) {
+        cl_int err;
+        vectors_ = clCreateBuffer(device.context(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  sizeof(float) * vectors.size(), (void *) vectors.data(), &err);
+        if (err != CL_SUCCESS) vectors_ = nullptr;
+        dst_ = clCreateBuffer(device.context(), CL_MEM_WRITE_ONLY, sizeof(float) * window.width() * window.height(),
+                              nullptr, &err);
+        if (err != CL_SUCCESS) dst_ = nullptr;
+
+        // noise for the window streamlines can reach, +1 for the bilinear neighbour - see LICPlugin::renderOpenCL()
+        RectI sampleRegion = window.expanded(numSteps + 1);
+        noiseBounds_ = {sampleRegion.x1, sampleRegion.y1, sampleRegion.x2 + 1, sampleRegion.y2 + 1};
+        noiseTexture_.reset(new NoiseTexture(NoiseFunction(eNoiseSimplex, 0), kFrequency, 1.0));
+        for (int tile: noiseTexture_->prepare(noiseBounds_)) {
+            noiseTexture_->bakeTile(tile);
+        }
+        noise_.resize((size_t) noiseBounds_.width() * noiseBounds_.height());
+        weightSum_ = build_step_weights(weights_, numSteps, false, 5, 0);
+    }
+
+    ~OpenCLRender() {
+        if (vectors_) clReleaseMemObject(vectors_);
+        if (dst_) clReleaseMemObject(dst_);
+    }
+
+    bool render() {
+        if (!vectors_ || !dst_) return false;
+        noiseTexture_->copyRegion(noiseBounds_, noise_.data());
+
+        OpenCLKernelArgs args;
+        args.vectorX = {vectors_, window_, 2, 2 * window_.width(), 0};
+        args.vectorY = {vectors_, window_, 2, 2 * window_.width(), 1};
+        args.dst = {dst_, window_, 1, window_.width(), 0};
+        args.half = false;
+        args.renderWindow = window_;
+        args.noise = noise_.data();
+        args.noiseBounds = noiseBounds_;
+        args.numSteps = numSteps_;
+        args.weights = weights_.data() + numSteps_;
+        args.weightSum = weightSum_;
+        args.forwardSteps = weighted_steps(weights_, numSteps_, +1);
+        args.backwardSteps = weighted_steps(weights_, numSteps_, -1);
+        args.bilinearVectors = false;
+        args.stopAtBoundary = false;
+        return licOpenCL(device_.queue(), args) && clFinish(device_.queue()) == CL_SUCCESS;
+    }
+
+private:
+    const OpenCLDevice &device_;
+    RectI window_;
+    int numSteps_;
+    cl_mem vectors_, dst_;
+    std::unique_ptr<NoiseTexture> noiseTexture_;
+    RectI noiseBounds_;
+    std::vector<float> noise_;
+    std::vector<float> weights_;
+    float weightSum_;
+};
+#endif
+
+// Interleaved (x, y) vectors of a vortex around the centre of the image
+std::vector<float> vortexVectors(int width, int height) {
+    std::vector<float> vectors((size_t) 2 * width * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float *v = &vectors[2 * ((size_t) y * width + x)];
+            v[0] = 0.5f * (float) height - (float) y;
+            v[1] = (float) x - 0.5f * (float) width;
+        }
+    }
+    return vectors;
+}
+
+std::vector<std::string> parseNames(const char *s) {
+    std::vector<std::string> names;
+    std::string all = s;
+    size_t start = 0;
+    while (start <= all.size()) {
+        size_t end = all.find(',', start);
+        if (end == std::string::npos) end = all.size();
+        names.push_back(all.substr(start, end - start));
+        start = end + 1;
+    }
+    return names;
+}
+
+bool parsePositiveInts(const char *s, std::vector<int> &values) {
+    values.clear();
+    for (const std::string &name: parseNames(s)) {
+        int value = std::atoi(name.c_str());
+        if (value < 1) return false;
+        values.push_back(value);
+    }
+    return true;
+}
+
+void usage() {
+    fprintf(stderr, "usage: lic_scaling [--threads N,...] [--sizes WxH,...] [--steps N,...] "
+                    "[--kernels reference,simd,fastlic,gpu] [--reps N]\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threads;
+    for (int n = 1; n <= 128 && n <= (int) hardwareThreads; n *= 2) {
+        threads.push_back(n);
+    }
+    if (hardwareThreads <= 128 && threads.back() != (int) hardwareThreads) {
+        threads.push_back((int) hardwareThreads);
+    }
+    std::vector<std::pair<int, int>> sizes = {{1920, 1080}, {3840, 2160}, {7680, 4320}};
+    std::vector<int> steps = {5, 15, 50};
+    std::vector<int> kernels = {eKernelReference, eKernelSIMD, eKernelFastLIC, eKernelGPU};
+    int reps = 3;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--threads" && hasValue) {
+            ok = parsePositiveInts(argv[++i], threads);
+        } else if (arg == "--sizes" && hasValue) {
+            sizes.clear();
+            for (const std::string &s: parseNames(argv[++i])) {
+                int w, h;
+                ok = ok && sscanf(s.c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+                sizes.emplace_back(w, h);
+            }
+        } else if (arg == "--steps" && hasValue) {
+            ok = parsePositiveInts(argv[++i], steps);
+        } else if (arg == "--kernels" && hasValue) {
+            kernels.clear();
+            for (const std::string &name: parseNames(argv[++i])) {
+                auto it = std::find(std::begin(kKernelNames), std::end(kKernelNames), name);
+                ok = ok && it != std::end(kKernelNames);
+                kernels.push_back((int) (it - std::begin(kKernelNames)));
+            }
+        } else if (arg == "--reps" && hasValue) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage();
+            return 2;
+        }
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+    if (threads.back() == 1) {
+        fprintf(stderr, "lic_scaling: single threaded runs only, speedup and efficiency are 1 by definition\n");
+    } else if (threads.back() > (int) hardwareThreads) {
+        fprintf(stderr, "lic_scaling: more threads than the %u hardware threads only measure oversubscription\n",
+                hardwareThreads);
+    }
+
+    // kernels this build and machine can't run are left out rather than falling back to another one
+    if (!getSimdRowKernel(getSimdInstructionSet()) &&
+        std::find(kernels.begin(), kernels.end(), (int) eKernelSIMD) != kernels.end()) {
+        fprintf(stderr, "lic_scaling: no SIMD kernel on this CPU, skipping simd\n");
+        kernels.erase(std::find(kernels.begin(), kernels.end(), (int) eKernelSIMD));
+    }
+#ifdef LIC_HAVE_OPENCL
+    OpenCLDevice device;
+    bool haveDevice = device.init();
+    if (haveDevice) {
+        fprintf(stderr, "lic_scaling: gpu is %s\n", device.name().c_str());
+    }
+#else
+    bool haveDevice = false;
+#endif
+    if (!haveDevice && std::find(kernels.begin(), kernels.end(), (int) eKernelGPU) != kernels.end()) {
+        fprintf(stderr, "lic_scaling: no OpenCL device, skipping gpu\n");
+        kernels.erase(std::find(kernels.begin(), kernels.end(), (int) eKernelGPU));
+    }
+
+    // vectors are packed and noise baked on all the hardware threads, only render() is timed
+    LICStdThreadPool preparePool;
+    printf("kernel,width,height,num_steps,threads,hardware_threads,ms,mpix_per_s,ns_per_step,speedup,efficiency\n");
+    int failures = 0;
+
+    for (const auto &size: sizes) {
+        int width = size.first, height = size.second;
+        std::vector<float> vectors = vortexVectors(width, height);
+        RectI window = {0, 0, width, height};
+        LICConstImage vectorX = {vectors.data(), window, 2, (ptrdiff_t) 2 * width};
+        LICConstImage vectorY = {vectors.data() + 1, window, 2, (ptrdiff_t) 2 * width};
+        std::vector<float> dst((size_t) width * height);
+        LICImage dstImage = {dst.data(), window, 1, width};
+        double pixels = (double) width * height;
+
+        for (int numSteps: steps) {
+            for (int kernel: kernels) {
+                auto report = [&](int numThreads, const Timing &timing, double singleThreadSeconds) {
+                    if (!timing.ok) {
+                        fprintf(stderr, "lic_scaling: %s %dx%d failed\n", kKernelNames[kernel], width, height);
+                        failures++;
+                        return;
+                    }
+                    printf("%s,%d,%d,%d,%d,%u,%.2f,%.3f,%.4f,", kKernelNames[kernel], width, height, numSteps,
+                           numThreads, hardwareThreads, timing.seconds * 1e3, pixels / timing.seconds * 1e-6,
+                           timing.seconds * 1e9 / (pixels * 2 * numSteps));
+                    if (singleThreadSeconds > 0.0) {
+                        double speedup = singleThreadSeconds / timing.seconds;
+                        printf("%.3f,%.3f\n", speedup, speedup / numThreads);
+                    } else {
+                        printf(",\n");
+                    }
+                    fflush(stdout);
+                };
+
+                if (kernel == eKernelGPU) {
+#ifdef LIC_HAVE_OPENCL
+                    OpenCLRender gpu(device, vectors, window, numSteps);
+                    report(0, bestOf(reps, [&]() { return gpu.render(); }), 0.0);
+#endif
+                    continue;
+                }
+
+                LICParams params;
+                params.frequency = kFrequency;
+                params.numSteps = numSteps;
+                params.bakeNoise = true;
+                params.useSimd = kernel == eKernelSIMD;
+                params.fastLic = kernel == eKernelFastLIC;
+                LICRenderer renderer(params);
+                renderer.prepare(vectorX, vectorY, window, preparePool);
+
+                double singleThreadSeconds = 0.0;
+                for (int numThreads: threads) {
+                    LICStdThreadPool pool((unsigned int) numThreads);
+                    Timing timing = bestOf(reps, [&]() { return renderer.render(dstImage, pool); });
+                    if (numThreads == 1) singleThreadSeconds = timing.seconds;
+                    report(numThreads, timing, singleThreadSeconds);
+                }
+            }
+        }
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "lic_scaling: %d case(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
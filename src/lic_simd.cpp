@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "lic_simd.h"
+
+#if defined(LIC_HAVE_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static SimdInstructionSetEnum detectSimdInstructionSet() {
+#ifdef LIC_HAVE_AVX2
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool f16c = (info[2] & (1 << 29)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        // the OS must save the YMM registers too
+        if (avx2 && fma && f16c && osxsave && (_xgetbv(0) & 6) == 6) {
+            return eSimdAVX2;
+        }
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        return eSimdAVX2;
+    }
+#endif
+#endif
+
+#ifdef LIC_HAVE_NEON
+    // NEON is mandatory on 64-bit ARM
+    return eSimdNEON;
+#endif
+
+    return eSimdNone;
+}
+
+SimdInstructionSetEnum getSimdInstructionSet() {
+    static const SimdInstructionSetEnum instructionSet = detectSimdInstructionSet();
+    return instructionSet;
+}
+
+SimdRowKernel getSimdRowKernel(SimdInstructionSetEnum instructionSet) {
+    switch (instructionSet) {
+#ifdef LIC_HAVE_AVX2
+        case eSimdAVX2: return licRowAVX2;
+#endif
+#ifdef LIC_HAVE_NEON
+        case eSimdNEON: return licRowNEON;
+#endif
+        default: return nullptr;
+    }
+}
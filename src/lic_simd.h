@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "direction_field.h"
+#include "rect.h"
+
+// Vectorized LIC integration - streamlines of 8 (AVX2) or 4 (NEON) neighbouring pixels in a row are advanced
+// in lockstep. This is the same algorithm as LICProcessor with baked noise, which remains the reference.
+
+enum SimdInstructionSetEnum {
+    eSimdNone = 0,
+    eSimdAVX2,
+    eSimdNEON,
+};
+
+struct SimdKernelArgs {
+    // unit directions, invalid pixels have zero direction
+    const DirectionField *directionField;
+    // contiguous copy of the baked noise texture covering noiseBounds
+    const float *noise;
+    RectI noiseBounds;
+    int numSteps;
+    // step weights indexed from -numSteps to +numSteps, ie. points to the middle of the table
+    const float *weights;
+    float weightSum;
+    // steps up to the last non-zero weight forward and backward (see weighted_steps()), zero weight steps
+    // in between are integrated without sampling the noise
+    int forwardSteps, backwardSteps;
+    // dst is half float instead of float
+    bool halfOutput;
+    // 4 for RGBA, 1 for Alpha output
+    int dstComponents;
+    // bilinear instead of nearest neighbour direction lookups, see DirectionField::sampleBilinear()
+    bool bilinearVectors;
+};
+
+// Integrates pixels [x1, x2) of row y and writes them as RGBA or Alpha into dst
+typedef void (*SimdRowKernel)(const SimdKernelArgs &args, int y, int x1, int x2, void *dst);
+
+// Best instruction set supported by both this build and the CPU we're running on (detected once)
+SimdInstructionSetEnum getSimdInstructionSet();
+
+// Row kernel for the instruction set, or nullptr if not available in this build
+SimdRowKernel getSimdRowKernel(SimdInstructionSetEnum instructionSet);
+
+#ifdef LIC_HAVE_AVX2
+void licRowAVX2(const SimdKernelArgs &args, int y, int x1, int x2, void *dst);
+#endif
+
+#ifdef LIC_HAVE_NEON
+void licRowNEON(const SimdKernelArgs &args, int y, int x1, int x2, void *dst);
+#endif
@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// This file is compiled with AVX2, FMA and F16C enabled, call it only after checking getSimdInstructionSet()
+
+#include "lic_simd.h"
+
+#ifdef LIC_HAVE_AVX2
+
+#include <algorithm>
+#include <cstdint>
+#include <immintrin.h>
+
+namespace {
+
+const int kLanes = 8;
+
+struct AVX2Context {
+    const float *dirs;
+    __m256i dirX1, dirY1, dirWidth;
+    int dirStride;
+    const float *noise;
+    __m256i noiseX1, noiseY1, noiseWidth;
+    int noiseStride;
+
+    explicit AVX2Context(const SimdKernelArgs &args) {
+        const RectI &db = args.directionField->bounds();
+        dirs = args.directionField->at(db.x1, db.y1);
+        dirX1 = _mm256_set1_epi32(db.x1);
+        dirY1 = _mm256_set1_epi32(db.y1);
+        dirWidth = _mm256_set1_epi32(db.width());
+        dirStride = 2 * db.width();
+        noise = args.noise;
+        noiseX1 = _mm256_set1_epi32(args.noiseBounds.x1);
+        noiseY1 = _mm256_set1_epi32(args.noiseBounds.y1);
+        noiseWidth = _mm256_set1_epi32(args.noiseBounds.width());
+        noiseStride = args.noiseBounds.width();
+    }
+
+    // nearest neighbour (truncated) direction lookup, same as LICProcessor::sampleDirection()
+    inline void sampleDirection(__m256 px, __m256 py, __m256 &ux, __m256 &uy) const {
+        __m256i ix = _mm256_cvttps_epi32(px);
+        __m256i iy = _mm256_cvttps_epi32(py);
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(iy, dirY1), dirWidth),
+                                       _mm256_sub_epi32(ix, dirX1));
+        idx = _mm256_add_epi32(idx, idx);
+        ux = _mm256_i32gather_ps(dirs, idx, 4);
+        uy = _mm256_i32gather_ps(dirs + 1, idx, 4);
+    }
+
+    // bilinear direction lookup, same as DirectionField::sampleBilinear()
+    inline void sampleDirectionBilinear(__m256 px, __m256 py, __m256 &ux, __m256 &uy) const {
+        const __m256 zero = _mm256_setzero_ps();
+        // validity and the fallback for cancelled out directions come from the nearest lookup
+        sampleDirection(px, py, ux, uy);
+        __m256 valid = _mm256_or_ps(_mm256_cmp_ps(ux, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(uy, zero, _CMP_NEQ_UQ));
+
+        __m256 fx = _mm256_floor_ps(px);
+        __m256 fy = _mm256_floor_ps(py);
+        __m256i idx = _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvttps_epi32(fy), dirY1), dirWidth),
+                _mm256_sub_epi32(_mm256_cvttps_epi32(fx), dirX1));
+        idx = _mm256_add_epi32(idx, idx);
+        __m256 t00x = _mm256_i32gather_ps(dirs, idx, 4);
+        __m256 t00y = _mm256_i32gather_ps(dirs + 1, idx, 4);
+        __m256 t01x = _mm256_i32gather_ps(dirs + 2, idx, 4);
+        __m256 t01y = _mm256_i32gather_ps(dirs + 3, idx, 4);
+        __m256 t10x = _mm256_i32gather_ps(dirs + dirStride, idx, 4);
+        __m256 t10y = _mm256_i32gather_ps(dirs + dirStride + 1, idx, 4);
+        __m256 t11x = _mm256_i32gather_ps(dirs + dirStride + 2, idx, 4);
+        __m256 t11y = _mm256_i32gather_ps(dirs + dirStride + 3, idx, 4);
+
+        __m256 ax = _mm256_sub_ps(px, fx);
+        __m256 ay = _mm256_sub_ps(py, fy);
+        __m256 topX = _mm256_fmadd_ps(ax, _mm256_sub_ps(t01x, t00x), t00x);
+        __m256 topY = _mm256_fmadd_ps(ax, _mm256_sub_ps(t01y, t00y), t00y);
+        __m256 bottomX = _mm256_fmadd_ps(ax, _mm256_sub_ps(t11x, t10x), t10x);
+        __m256 bottomY = _mm256_fmadd_ps(ax, _mm256_sub_ps(t11y, t10y), t10y);
+        __m256 vx = _mm256_fmadd_ps(ay, _mm256_sub_ps(bottomX, topX), topX);
+        __m256 vy = _mm256_fmadd_ps(ay, _mm256_sub_ps(bottomY, topY), topY);
+
+        __m256 vmag = _mm256_sqrt_ps(_mm256_fmadd_ps(vx, vx, _mm256_mul_ps(vy, vy)));
+        __m256 use = _mm256_and_ps(valid, _mm256_cmp_ps(vmag, zero, _CMP_GT_OQ));
+        ux = _mm256_blendv_ps(ux, _mm256_div_ps(vx, vmag), use);
+        uy = _mm256_blendv_ps(uy, _mm256_div_ps(vy, vmag), use);
+    }
+
+    // bilinear noise lookup, same as NoiseTexture::sample()
+    inline __m256 sampleNoise(__m256 px, __m256 py) const {
+        __m256 fx = _mm256_floor_ps(px);
+        __m256 fy = _mm256_floor_ps(py);
+        __m256i idx = _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvttps_epi32(fy), noiseY1), noiseWidth),
+                _mm256_sub_epi32(_mm256_cvttps_epi32(fx), noiseX1));
+        __m256 t00 = _mm256_i32gather_ps(noise, idx, 4);
+        __m256 t01 = _mm256_i32gather_ps(noise + 1, idx, 4);
+        __m256 t10 = _mm256_i32gather_ps(noise + noiseStride, idx, 4);
+        __m256 t11 = _mm256_i32gather_ps(noise + noiseStride + 1, idx, 4);
+
+        __m256 ax = _mm256_sub_ps(px, fx);
+        __m256 ay = _mm256_sub_ps(py, fy);
+        __m256 top = _mm256_fmadd_ps(ax, _mm256_sub_ps(t01, t00), t00);
+        __m256 bottom = _mm256_fmadd_ps(ax, _mm256_sub_ps(t11, t10), t10);
+        return _mm256_fmadd_ps(ay, _mm256_sub_ps(bottom, top), top);
+    }
+};
+
+// One direction of the integration, sign = +1 forward, -1 backward
+template<int Sign, bool Bilinear>
+inline __m256 integrate(const AVX2Context &ctx, const SimdKernelArgs &args, __m256 px, __m256 py,
+                        __m256 ux_last, __m256 uy_last, __m256 acc) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 use_last = zero;
+    __m256 ux = ux_last, uy = uy_last;
+
+    int numSteps = Sign > 0 ? args.forwardSteps : args.backwardSteps;
+    for (int i = 0; i < numSteps; i++) {
+        // once all lanes are out of valid area, there's nothing more to fetch
+        if (_mm256_movemask_ps(use_last) != 0xff) {
+            if (Bilinear) {
+                ctx.sampleDirectionBilinear(px, py, ux, uy);
+            } else {
+                ctx.sampleDirection(px, py, ux, uy);
+            }
+            __m256 invalid = _mm256_and_ps(_mm256_cmp_ps(ux, zero, _CMP_EQ_OQ), _mm256_cmp_ps(uy, zero, _CMP_EQ_OQ));
+            use_last = _mm256_or_ps(use_last, invalid);
+        }
+        ux = _mm256_blendv_ps(ux, ux_last, use_last);
+        uy = _mm256_blendv_ps(uy, uy_last, use_last);
+
+        if (Sign > 0) {
+            px = _mm256_add_ps(px, ux);
+            py = _mm256_add_ps(py, uy);
+        } else {
+            px = _mm256_sub_ps(px, ux);
+            py = _mm256_sub_ps(py, uy);
+        }
+
+        float weight = args.weights[Sign * (i + 1)];
+        if (weight != 0.0f) {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(weight), ctx.sampleNoise(px, py), acc);
+        }
+        ux_last = ux;
+        uy_last = uy;
+    }
+
+    return acc;
+}
+
+// interleaves value and alpha lanes into RGBA pixels, or writes just the values for Alpha output
+template<typename PIX>
+inline void storePixels(PIX *dst, int components, const PIX *values, const PIX *alphas, int n) {
+    if (components == 1) {
+        std::copy(values, values + n, dst);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        dst[0] = values[i]; // = R
+        dst[1] = values[i]; // = G
+        dst[2] = values[i]; // = B
+        dst[3] = alphas[i]; // = A
+        dst += 4;
+    }
+}
+
+}
+
+void licRowAVX2(const SimdKernelArgs &args, int y, int x1, int x2, void *dst) {
+    const AVX2Context ctx(args);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 laneOffsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 weightSum = _mm256_set1_ps(args.weightSum);
+    const __m256 py0 = _mm256_set1_ps((float) y);
+    alignas(32) float values[kLanes], alphas[kLanes];
+    alignas(16) uint16_t halfValues[kLanes], halfAlphas[kLanes];
+
+    for (int x = x1; x < x2; x += kLanes) {
+        int n = std::min(kLanes, x2 - x);
+        // lanes past the end of the row repeat the last pixel, so that they stay inside the direction field
+        __m256 px0 = _mm256_min_ps(_mm256_add_ps(_mm256_set1_ps((float) x), laneOffsets),
+                                   _mm256_set1_ps((float) (x2 - 1)));
+
+        __m256 acc = args.weights[0] != 0.0f ? _mm256_mul_ps(_mm256_set1_ps(args.weights[0]), ctx.sampleNoise(px0, py0))
+                                             : zero;
+        __m256 ux_initial, uy_initial;
+        ctx.sampleDirection(px0, py0, ux_initial, uy_initial);
+        __m256 valid = _mm256_or_ps(_mm256_cmp_ps(ux_initial, zero, _CMP_NEQ_UQ),
+                                    _mm256_cmp_ps(uy_initial, zero, _CMP_NEQ_UQ));
+
+        if (_mm256_movemask_ps(valid) != 0 && args.weightSum >= 0.5f && args.bilinearVectors) {
+            acc = integrate<+1, true>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+            acc = integrate<-1, true>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+        } else if (_mm256_movemask_ps(valid) != 0 && args.weightSum >= 0.5f) {
+            acc = integrate<+1, false>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+            acc = integrate<-1, false>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+        } else {
+            valid = zero;
+        }
+
+        // masked pixels get transparent black, as in LICProcessor
+        __m256 value = _mm256_and_ps(_mm256_div_ps(acc, weightSum), valid);
+        __m256 alpha = _mm256_and_ps(_mm256_set1_ps(1.0f), valid);
+
+        if (args.halfOutput) {
+            _mm_store_si128((__m128i *) halfValues, _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+            _mm_store_si128((__m128i *) halfAlphas, _mm256_cvtps_ph(alpha, _MM_FROUND_TO_NEAREST_INT));
+            storePixels((uint16_t *) dst + args.dstComponents * (x - x1), args.dstComponents, halfValues, halfAlphas, n);
+        } else {
+            _mm256_store_ps(values, value);
+            _mm256_store_ps(alphas, alpha);
+            storePixels((float *) dst + args.dstComponents * (x - x1), args.dstComponents, values, alphas, n);
+        }
+    }
+}
+
+#endif
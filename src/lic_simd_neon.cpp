@@ -0,0 +1,250 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "lic_simd.h"
+
+#ifdef LIC_HAVE_NEON
+
+#include <algorithm>
+#include <cstdint>
+#include <arm_neon.h>
+
+namespace {
+
+const int kLanes = 4;
+
+struct NEONContext {
+    const float *dirs;
+    int32x4_t dirX1, dirY1, dirWidth;
+    int dirStride;
+    const float *noise;
+    int32x4_t noiseX1, noiseY1, noiseWidth;
+    int noiseStride;
+
+    explicit NEONContext(const SimdKernelArgs &args) {
+        const RectI &db = args.directionField->bounds();
+        dirs = args.directionField->at(db.x1, db.y1);
+        dirX1 = vdupq_n_s32(db.x1);
+        dirY1 = vdupq_n_s32(db.y1);
+        dirWidth = vdupq_n_s32(db.width());
+        dirStride = 2 * db.width();
+        noise = args.noise;
+        noiseX1 = vdupq_n_s32(args.noiseBounds.x1);
+        noiseY1 = vdupq_n_s32(args.noiseBounds.y1);
+        noiseWidth = vdupq_n_s32(args.noiseBounds.width());
+        noiseStride = args.noiseBounds.width();
+    }
+
+    // NEON has no gather, so lanes are loaded one by one
+    static inline float32x4_t gather(const float *base, int32x4_t idx) {
+        float32x4_t v = vdupq_n_f32(0.0f);
+        v = vld1q_lane_f32(base + vgetq_lane_s32(idx, 0), v, 0);
+        v = vld1q_lane_f32(base + vgetq_lane_s32(idx, 1), v, 1);
+        v = vld1q_lane_f32(base + vgetq_lane_s32(idx, 2), v, 2);
+        v = vld1q_lane_f32(base + vgetq_lane_s32(idx, 3), v, 3);
+        return v;
+    }
+
+    // nearest neighbour (truncated) direction lookup, same as LICProcessor::sampleDirection()
+    inline void sampleDirection(float32x4_t px, float32x4_t py, float32x4_t &ux, float32x4_t &uy) const {
+        int32x4_t idx = vmlaq_s32(vsubq_s32(vcvtq_s32_f32(px), dirX1), vsubq_s32(vcvtq_s32_f32(py), dirY1), dirWidth);
+        float32x4_t lo = vcombine_f32(vld1_f32(dirs + 2 * vgetq_lane_s32(idx, 0)),
+                                      vld1_f32(dirs + 2 * vgetq_lane_s32(idx, 1)));
+        float32x4_t hi = vcombine_f32(vld1_f32(dirs + 2 * vgetq_lane_s32(idx, 2)),
+                                      vld1_f32(dirs + 2 * vgetq_lane_s32(idx, 3)));
+        // de-interleave (x, y) pairs
+        ux = vuzp1q_f32(lo, hi);
+        uy = vuzp2q_f32(lo, hi);
+    }
+
+    // directions at pixel idx and its right neighbour (two (x, y) pairs next to each other), de-interleaved
+    static inline void loadPairs(const float *base, int32x4_t idx, float32x4_t &x0, float32x4_t &y0,
+                                 float32x4_t &x1, float32x4_t &y1) {
+        float32x4_t q0 = vld1q_f32(base + 2 * vgetq_lane_s32(idx, 0));
+        float32x4_t q1 = vld1q_f32(base + 2 * vgetq_lane_s32(idx, 1));
+        float32x4_t q2 = vld1q_f32(base + 2 * vgetq_lane_s32(idx, 2));
+        float32x4_t q3 = vld1q_f32(base + 2 * vgetq_lane_s32(idx, 3));
+        float32x4_t xs01 = vuzp1q_f32(q0, q1), ys01 = vuzp2q_f32(q0, q1);
+        float32x4_t xs23 = vuzp1q_f32(q2, q3), ys23 = vuzp2q_f32(q2, q3);
+        x0 = vuzp1q_f32(xs01, xs23);
+        x1 = vuzp2q_f32(xs01, xs23);
+        y0 = vuzp1q_f32(ys01, ys23);
+        y1 = vuzp2q_f32(ys01, ys23);
+    }
+
+    // bilinear direction lookup, same as DirectionField::sampleBilinear()
+    inline void sampleDirectionBilinear(float32x4_t px, float32x4_t py, float32x4_t &ux, float32x4_t &uy) const {
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        // validity and the fallback for cancelled out directions come from the nearest lookup
+        sampleDirection(px, py, ux, uy);
+        uint32x4_t valid = vmvnq_u32(vandq_u32(vceqq_f32(ux, zero), vceqq_f32(uy, zero)));
+
+        float32x4_t fx = vrndmq_f32(px);
+        float32x4_t fy = vrndmq_f32(py);
+        int32x4_t idx = vmlaq_s32(vsubq_s32(vcvtq_s32_f32(fx), dirX1), vsubq_s32(vcvtq_s32_f32(fy), dirY1), dirWidth);
+        float32x4_t t00x, t00y, t01x, t01y, t10x, t10y, t11x, t11y;
+        loadPairs(dirs, idx, t00x, t00y, t01x, t01y);
+        loadPairs(dirs + dirStride, idx, t10x, t10y, t11x, t11y);
+
+        float32x4_t ax = vsubq_f32(px, fx);
+        float32x4_t ay = vsubq_f32(py, fy);
+        float32x4_t topX = vfmaq_f32(t00x, ax, vsubq_f32(t01x, t00x));
+        float32x4_t topY = vfmaq_f32(t00y, ax, vsubq_f32(t01y, t00y));
+        float32x4_t bottomX = vfmaq_f32(t10x, ax, vsubq_f32(t11x, t10x));
+        float32x4_t bottomY = vfmaq_f32(t10y, ax, vsubq_f32(t11y, t10y));
+        float32x4_t vx = vfmaq_f32(topX, ay, vsubq_f32(bottomX, topX));
+        float32x4_t vy = vfmaq_f32(topY, ay, vsubq_f32(bottomY, topY));
+
+        float32x4_t vmag = vsqrtq_f32(vfmaq_f32(vmulq_f32(vy, vy), vx, vx));
+        uint32x4_t use = vandq_u32(valid, vcgtq_f32(vmag, zero));
+        ux = vbslq_f32(use, vdivq_f32(vx, vmag), ux);
+        uy = vbslq_f32(use, vdivq_f32(vy, vmag), uy);
+    }
+
+    // bilinear noise lookup, same as NoiseTexture::sample()
+    inline float32x4_t sampleNoise(float32x4_t px, float32x4_t py) const {
+        float32x4_t fx = vrndmq_f32(px);
+        float32x4_t fy = vrndmq_f32(py);
+        int32x4_t idx = vmlaq_s32(vsubq_s32(vcvtq_s32_f32(fx), noiseX1), vsubq_s32(vcvtq_s32_f32(fy), noiseY1),
+                                  noiseWidth);
+        float32x4_t t00 = gather(noise, idx);
+        float32x4_t t01 = gather(noise + 1, idx);
+        float32x4_t t10 = gather(noise + noiseStride, idx);
+        float32x4_t t11 = gather(noise + noiseStride + 1, idx);
+
+        float32x4_t ax = vsubq_f32(px, fx);
+        float32x4_t ay = vsubq_f32(py, fy);
+        float32x4_t top = vfmaq_f32(t00, ax, vsubq_f32(t01, t00));
+        float32x4_t bottom = vfmaq_f32(t10, ax, vsubq_f32(t11, t10));
+        return vfmaq_f32(top, ay, vsubq_f32(bottom, top));
+    }
+};
+
+// One direction of the integration, sign = +1 forward, -1 backward
+template<int Sign, bool Bilinear>
+inline float32x4_t integrate(const NEONContext &ctx, const SimdKernelArgs &args, float32x4_t px, float32x4_t py,
+                             float32x4_t ux_last, float32x4_t uy_last, float32x4_t acc) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    uint32x4_t use_last = vdupq_n_u32(0);
+    float32x4_t ux = ux_last, uy = uy_last;
+
+    int numSteps = Sign > 0 ? args.forwardSteps : args.backwardSteps;
+    for (int i = 0; i < numSteps; i++) {
+        // once all lanes are out of valid area, there's nothing more to fetch
+        if (vminvq_u32(use_last) == 0) {
+            if (Bilinear) {
+                ctx.sampleDirectionBilinear(px, py, ux, uy);
+            } else {
+                ctx.sampleDirection(px, py, ux, uy);
+            }
+            uint32x4_t invalid = vandq_u32(vceqq_f32(ux, zero), vceqq_f32(uy, zero));
+            use_last = vorrq_u32(use_last, invalid);
+        }
+        ux = vbslq_f32(use_last, ux_last, ux);
+        uy = vbslq_f32(use_last, uy_last, uy);
+
+        if (Sign > 0) {
+            px = vaddq_f32(px, ux);
+            py = vaddq_f32(py, uy);
+        } else {
+            px = vsubq_f32(px, ux);
+            py = vsubq_f32(py, uy);
+        }
+
+        float weight = args.weights[Sign * (i + 1)];
+        if (weight != 0.0f) {
+            acc = vfmaq_n_f32(acc, ctx.sampleNoise(px, py), weight);
+        }
+        ux_last = ux;
+        uy_last = uy;
+    }
+
+    return acc;
+}
+
+// interleaves value and alpha lanes into RGBA pixels, or writes just the values for Alpha output
+template<typename PIX>
+inline void storePixels(PIX *dst, int components, const PIX *values, const PIX *alphas, int n) {
+    if (components == 1) {
+        std::copy(values, values + n, dst);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        dst[0] = values[i]; // = R
+        dst[1] = values[i]; // = G
+        dst[2] = values[i]; // = B
+        dst[3] = alphas[i]; // = A
+        dst += 4;
+    }
+}
+
+}
+
+void licRowNEON(const SimdKernelArgs &args, int y, int x1, int x2, void *dst) {
+    const NEONContext ctx(args);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float laneOffsetsData[kLanes] = {0, 1, 2, 3};
+    const float32x4_t laneOffsets = vld1q_f32(laneOffsetsData);
+    const float32x4_t py0 = vdupq_n_f32((float) y);
+    float values[kLanes], alphas[kLanes];
+    uint16_t halfValues[kLanes], halfAlphas[kLanes];
+
+    for (int x = x1; x < x2; x += kLanes) {
+        int n = std::min(kLanes, x2 - x);
+        // lanes past the end of the row repeat the last pixel, so that they stay inside the direction field
+        float32x4_t px0 = vminq_f32(vaddq_f32(vdupq_n_f32((float) x), laneOffsets), vdupq_n_f32((float) (x2 - 1)));
+
+        float32x4_t acc = args.weights[0] != 0.0f ? vmulq_n_f32(ctx.sampleNoise(px0, py0), args.weights[0]) : zero;
+        float32x4_t ux_initial, uy_initial;
+        ctx.sampleDirection(px0, py0, ux_initial, uy_initial);
+        uint32x4_t valid = vmvnq_u32(vandq_u32(vceqq_f32(ux_initial, zero), vceqq_f32(uy_initial, zero)));
+
+        if (vmaxvq_u32(valid) != 0 && args.weightSum >= 0.5f && args.bilinearVectors) {
+            acc = integrate<+1, true>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+            acc = integrate<-1, true>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+        } else if (vmaxvq_u32(valid) != 0 && args.weightSum >= 0.5f) {
+            acc = integrate<+1, false>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+            acc = integrate<-1, false>(ctx, args, px0, py0, ux_initial, uy_initial, acc);
+        } else {
+            valid = vdupq_n_u32(0);
+        }
+
+        // masked pixels get transparent black, as in LICProcessor
+        float32x4_t value = vdivq_f32(acc, vdupq_n_f32(args.weightSum));
+        value = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(value), valid));
+        float32x4_t alpha = vbslq_f32(valid, vdupq_n_f32(1.0f), zero);
+
+        if (args.halfOutput) {
+            vst1_u16(halfValues, vreinterpret_u16_f16(vcvt_f16_f32(value)));
+            vst1_u16(halfAlphas, vreinterpret_u16_f16(vcvt_f16_f32(alpha)));
+            storePixels((uint16_t *) dst + args.dstComponents * (x - x1), args.dstComponents, halfValues, halfAlphas, n);
+        } else {
+            vst1q_f32(values, value);
+            vst1q_f32(alphas, alpha);
+            storePixels((float *) dst + args.dstComponents * (x - x1), args.dstComponents, values, alphas, n);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "SimplexNoise.h"
+
+enum NoiseTypeEnum {
+    eNoiseSimplex = 0,
+    eNoiseValue,
+    eNoiseWhite,
+};
+
+// The noise LIC convolves, in [-1; 1] at (x, y) in noise space (pixels times the frequency) - stateless, so it can
+// be evaluated from any thread. Value and white noise are built on an integer hash of the lattice point and
+// the seed, so they come out bit identical on every machine whatever the tiling of the render.
+//
+// Simplex is SimplexNoise with its domain shifted by the seed (seed 0 is the original, unshifted noise), value
+// noise interpolates random values at the integer lattice points, white noise is one random value per lattice cell
+// (at frequency 1, one per pixel - the classic LIC input).
+class NoiseFunction {
+public:
+    explicit NoiseFunction(int type = eNoiseSimplex, uint32_t seed = 0)
+            : type_(type), seed_(seed), seedHash_(mix(seed)), offsetX_(0.0f), offsetY_(0.0f) {
+        if (seed != 0) {
+            // anywhere within the 256 lattice units period of the permutation table
+            offsetX_ = (float) (seedHash_ & 0xffff) * (1.0f / 256.0f);
+            offsetY_ = (float) (seedHash_ >> 16) * (1.0f / 256.0f);
+        }
+    }
+
+    int type() const { return type_; }
+
+    uint32_t seed() const { return seed_; }
+
+    bool operator==(const NoiseFunction &o) const { return type_ == o.type_ && seed_ == o.seed_; }
+
+    bool operator!=(const NoiseFunction &o) const { return !(*this == o); }
+
+    inline float noise(float x, float y) const {
+        switch (type_) {
+            case eNoiseValue: return valueNoise(x, y);
+            case eNoiseWhite: return lattice((int) std::floor(x), (int) std::floor(y));
+            default: return SimplexNoise::noise(x + offsetX_, y + offsetY_);
+        }
+    }
+
+private:
+    int type_;
+    uint32_t seed_;
+    uint32_t seedHash_;
+    float offsetX_, offsetY_;
+
+    // lowbias32 by Chris Wellons
+    static inline uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x7feb352dU;
+        h ^= h >> 15;
+        h *= 0x846ca68bU;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // random value of the lattice point, uniform in [-1; 1)
+    inline float lattice(int i, int j) const {
+        uint32_t h = mix(mix(seedHash_ ^ (uint32_t) j) ^ (uint32_t) i);
+        return (float) (h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+    }
+
+    inline float valueNoise(float x, float y) const {
+        float fx = std::floor(x), fy = std::floor(y);
+        int i = (int) fx, j = (int) fy;
+        // smoothstep, so that the noise has no creases along the lattice
+        float ax = x - fx, ay = y - fy;
+        ax = ax * ax * (3.0f - 2.0f * ax);
+        ay = ay * ay * (3.0f - 2.0f * ay);
+
+        float t0 = lattice(i, j), t1 = lattice(i + 1, j);
+        float b0 = lattice(i, j + 1), b1 = lattice(i + 1, j + 1);
+        float top = t0 + ax * (t1 - t0);
+        float bottom = b0 + ax * (b1 - b0);
+        return top + ay * (bottom - top);
+    }
+};
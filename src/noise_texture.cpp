@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "noise_texture.h"
+
+NoiseTexture::NoiseTexture(const NoiseFunction &noise, float frequency, double renderScale)
+        : noise_(noise), frequency_(frequency), renderScale_(renderScale), texelFrequency_((float) (frequency / renderScale)),
+          tx1_(0), ty1_(0), gridWidth_(0), gridHeight_(0) {
+}
+
+std::vector<int> NoiseTexture::prepare(const RectI &region) {
+    std::vector<int> pending;
+    if (region.isEmpty()) return pending;
+
+    RectI tileRect = tilesOverlapping(region);
+    RectI grid = {tx1_, ty1_, tx1_ + gridWidth_, ty1_ + gridHeight_};
+
+    if (grid.isEmpty()) {
+        resizeGrid(tileRect);
+    } else if (!grid.contains(tileRect)) {
+        RectI newGrid = grid.united(tileRect);
+        if (newGrid.width() * newGrid.height() > kMaxTiles) {
+            // the windows we're asked for are all over the place, start over rather than hog the memory
+            newGrid = tileRect;
+        }
+        resizeGrid(newGrid);
+    }
+
+    for (int ty = tileRect.y1; ty < tileRect.y2; ty++) {
+        for (int tx = tileRect.x1; tx < tileRect.x2; tx++) {
+            int idx = (ty - ty1_) * gridWidth_ + (tx - tx1_);
+            if (!tiles_[idx]) {
+                tiles_[idx].reset(new float[kTileStride * kTileStride], std::default_delete<float[]>());
+                pending.push_back(idx);
+            }
+        }
+    }
+
+    return pending;
+}
+
+bool NoiseTexture::covers(const RectI &region) const {
+    if (region.isEmpty()) return true;
+
+    RectI tileRect = tilesOverlapping(region);
+    RectI grid = {tx1_, ty1_, tx1_ + gridWidth_, ty1_ + gridHeight_};
+    if (!grid.contains(tileRect)) return false;
+
+    for (int ty = tileRect.y1; ty < tileRect.y2; ty++) {
+        for (int tx = tileRect.x1; tx < tileRect.x2; tx++) {
+            if (!tiles_[(ty - ty1_) * gridWidth_ + (tx - tx1_)]) return false;
+        }
+    }
+    return true;
+}
+
+void NoiseTexture::bakeTile(int tileIndex) {
+    int x0 = (tx1_ + tileIndex % gridWidth_) * kTileSize;
+    int y0 = (ty1_ + tileIndex / gridWidth_) * kTileSize;
+    float *t = tiles_[tileIndex].get();
+
+    for (int j = 0; j < kTileStride; j++) {
+        for (int i = 0; i < kTileStride; i++) {
+            auto x = (float) (x0 + i), y = (float) (y0 + j);
+            t[j * kTileStride + i] = 0.5f + 0.5f * noise_.noise(texelFrequency_ * x, texelFrequency_ * y);
+        }
+    }
+}
+
+void NoiseTexture::copyRegion(const RectI &region, float *dst) const {
+    for (int y = region.y1; y < region.y2; y++) {
+        for (int x = region.x1; x < region.x2; x++) {
+            *dst++ = texel(x, y);
+        }
+    }
+}
+
+void NoiseTexture::resizeGrid(const RectI &tileRect) {
+    std::vector<std::shared_ptr<float>> tiles(tileRect.width() * tileRect.height());
+
+    for (int ty = ty1_; ty < ty1_ + gridHeight_; ty++) {
+        for (int tx = tx1_; tx < tx1_ + gridWidth_; tx++) {
+            if (tx >= tileRect.x1 && tx < tileRect.x2 && ty >= tileRect.y1 && ty < tileRect.y2) {
+                tiles[(ty - tileRect.y1) * tileRect.width() + (tx - tileRect.x1)] =
+                        std::move(tiles_[(ty - ty1_) * gridWidth_ + (tx - tx1_)]);
+            }
+        }
+    }
+
+    tiles_ = std::move(tiles);
+    tx1_ = tileRect.x1;
+    ty1_ = tileRect.y1;
+    gridWidth_ = tileRect.width();
+    gridHeight_ = tileRect.height();
+}
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "noise_function.h"
+#include "rect.h"
+
+// Noise baked into a sparse tiled texture, sampled with bilinear lookups.
+//
+// The texture lives in pixel coordinates and is made of kTileSize x kTileSize tiles that are baked on demand
+// as new render windows come in. Baked tiles are kept until the texture is thrown away, which is when the noise
+// function, frequency or render scale changes.
+//
+// Usage: call prepare() for the region you are going to sample, bake the returned tiles with bakeTile()
+// (this can be done from several threads), then call sample() from any number of threads.
+//
+// Copying the texture is cheap, tiles are shared between the copies. This is how a texture which is already
+// being sampled by other threads can be extended: prepare and bake a copy, then swap it in.
+class NoiseTexture {
+public:
+    static const int kTileShift = 6;
+    static const int kTileSize = 1 << kTileShift;
+    static const int kTileMask = kTileSize - 1;
+    // tiles have one extra row and column duplicating the neighbour, so that bilinear lookup stays in one tile
+    static const int kTileStride = kTileSize + 1;
+    // upper bound on the number of tiles we keep around, ~200 MB (enough for 8K with some margin)
+    static const int kMaxTiles = 12288;
+
+    NoiseTexture(const NoiseFunction &noise, float frequency, double renderScale);
+
+    bool isCompatible(const NoiseFunction &noise, float frequency, double renderScale) const {
+        return noise == noise_ && frequency == frequency_ && renderScale == renderScale_;
+    }
+
+    // Allocates tiles overlapping the region; returns indices of tiles that need to be baked
+    std::vector<int> prepare(const RectI &region);
+
+    // Whether all tiles overlapping the region are already there
+    bool covers(const RectI &region) const;
+
+    void bakeTile(int tileIndex);
+
+    // Bilinearly interpolated noise value in [0; 1] - (x, y) must be inside a prepared region
+    inline float sample(float x, float y) const {
+        float fx = std::floor(x), fy = std::floor(y);
+        int ix = (int) fx, iy = (int) fy;
+        int tx = (ix >> kTileShift) - tx1_;
+        int ty = (iy >> kTileShift) - ty1_;
+        const float *t = tiles_[ty * gridWidth_ + tx].get() + (iy & kTileMask) * kTileStride + (ix & kTileMask);
+
+        float ax = x - fx, ay = y - fy;
+        float top = t[0] + ax * (t[1] - t[0]);
+        float bottom = t[kTileStride] + ax * (t[kTileStride + 1] - t[kTileStride]);
+        return top + ay * (bottom - top);
+    }
+
+    // Noise value at pixel (x, y) - the pixel must be inside a prepared region
+    inline float texel(int x, int y) const {
+        int tx = (x >> kTileShift) - tx1_;
+        int ty = (y >> kTileShift) - ty1_;
+        return tiles_[ty * gridWidth_ + tx].get()[(y & kTileMask) * kTileStride + (x & kTileMask)];
+    }
+
+    // Copies the region into a contiguous row-major buffer, for lookups that are easier done without tiles
+    void copyRegion(const RectI &region, float *dst) const;
+
+private:
+    NoiseFunction noise_;
+    float frequency_;
+    double renderScale_;
+    float texelFrequency_;
+
+    // grid of tiles, in tile coordinates [tx1_, tx1_ + gridWidth_) x [ty1_, ty1_ + gridHeight_)
+    int tx1_, ty1_, gridWidth_, gridHeight_;
+    std::vector<std::shared_ptr<float>> tiles_;
+
+    void resizeGrid(const RectI &tileRect);
+
+    static RectI tilesOverlapping(const RectI &region) {
+        return {region.x1 >> kTileShift, region.y1 >> kTileShift,
+                ((region.x2 - 1) >> kTileShift) + 1, ((region.y2 - 1) >> kTileShift) + 1};
+    }
+};
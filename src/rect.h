@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+
+// Integer pixel rectangle, [x1, x2) x [y1, y2) - same layout as OfxRectI,
+// but usable in code that doesn't depend on OpenFX headers
+struct RectI {
+    int x1, y1, x2, y2;
+
+    int width() const { return x2 - x1; }
+
+    int height() const { return y2 - y1; }
+
+    bool isEmpty() const { return x2 <= x1 || y2 <= y1; }
+
+    bool contains(const RectI &r) const {
+        return r.x1 >= x1 && r.y1 >= y1 && r.x2 <= x2 && r.y2 <= y2;
+    }
+
+    RectI expanded(int d) const {
+        return {x1 - d, y1 - d, x2 + d, y2 + d};
+    }
+
+    RectI intersected(const RectI &r) const {
+        return {std::max(x1, r.x1), std::max(y1, r.y1), std::min(x2, r.x2), std::min(y2, r.y2)};
+    }
+
+    RectI united(const RectI &r) const {
+        return {std::min(x1, r.x1), std::min(y1, r.y1), std::max(x2, r.x2), std::max(y2, r.y2)};
+    }
+};
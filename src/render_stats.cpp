@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "render_stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static double milliseconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+std::string RenderStats::toJson(const char *processor, const RectI &window, int numSteps, int previewStride,
+                                std::chrono::steady_clock::time_point start,
+                                std::chrono::steady_clock::time_point end) const {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"processor\": \"%s\", \"window\": [%d, %d, %d, %d], \"num_steps\": %d, \"preview_stride\": %d, "
+             "\"ms\": %.3f, \"abort_latency_ms\": ",
+             processor, window.x1, window.y1, window.x2, window.y2, numSteps, previewStride,
+             milliseconds(end - start));
+    std::string json = buf;
+
+    if (aborted_.load()) {
+        snprintf(buf, sizeof(buf), "%.3f", milliseconds(end - abortTime_));
+        json += buf;
+    } else {
+        json += "null";
+    }
+
+    json += ", \"threads\": [";
+    for (size_t i = 0; i < threads_.size(); i++) {
+        const LICThreadStats &t = threads_[i];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"ms\": %.3f, \"tiles\": %llu, \"pixels\": %llu, \"steps\": %llu, \"extrapolated_steps\": %llu, "
+                 "\"masked_pixels\": %llu}",
+                 i > 0 ? ", " : "", t.seconds * 1e3, (unsigned long long) t.tiles, (unsigned long long) t.pixels,
+                 (unsigned long long) t.counts.steps, (unsigned long long) t.counts.extrapolatedSteps,
+                 (unsigned long long) t.counts.maskedPixels);
+        json += buf;
+    }
+    json += "]}";
+    return json;
+}
+
+StatsLog *StatsLog::instance() {
+    static StatsLog *log = []() -> StatsLog * {
+        const char *path = std::getenv("LIC_STATS_FILE");
+        if (!path || !*path) return nullptr;
+        return new StatsLog(path);
+    }();
+    return log;
+}
+
+void StatsLog::write(const std::string &line) {
+    // renders may finish concurrently, keep their lines whole
+    std::lock_guard<std::mutex> lock(mutex_);
+    FILE *f = fopen(path_.c_str(), "a");
+    if (!f) {
+        fprintf(stderr, "StatsLog: cannot write %s\n", path_.c_str());
+        return;
+    }
+    fputs(line.c_str(), f);
+    fputc('\n', f);
+    fclose(f);
+}
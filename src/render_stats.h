@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "lic_core.h"
+#include "rect.h"
+
+// Per render instrumentation - compiled in, but off unless LIC_STATS_FILE names a file. Every render then
+// appends one JSON line to it:
+//
+//   {"processor": "standard", "window": [0, 0, 1920, 1080], "num_steps": 15, "preview_stride": 1, "ms": 812.4,
+//    "abort_latency_ms": null, "threads": [{"ms": 811.9, "tiles": 57, "pixels": 259200, "steps": 7776000,
+//    "extrapolated_steps": 1520, "masked_pixels": 310}, ...]}
+//
+// Thread times are wall time from the thread's start to its last tile, so imbalance shows up as differing ms.
+// Step counters are described in LICStepCounts; the SIMD kernel doesn't count extrapolated steps. Abort latency
+// is from the first thread seeing the render aborted to the end of the render.
+
+struct LICThreadStats {
+    double seconds = 0.0;
+    uint64_t tiles = 0;
+    uint64_t pixels = 0;
+    LICStepCounts counts;
+};
+
+// Counters of one render, each thread updates its own LICThreadStats
+class RenderStats {
+public:
+    explicit RenderStats(unsigned int numThreads) : threads_(numThreads), aborted_(false) {}
+
+    unsigned int numThreads() const { return (unsigned int) threads_.size(); }
+
+    LICThreadStats &thread(unsigned int threadIndex) { return threads_[threadIndex]; }
+
+    // called by threads that see the render aborted, the first call is the one that counts
+    void noteAbort() {
+        bool expected = false;
+        if (aborted_.compare_exchange_strong(expected, true)) {
+            abortTime_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    // the JSON line, to be called once the threads are done
+    std::string toJson(const char *processor, const RectI &window, int numSteps, int previewStride,
+                       std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) const;
+
+private:
+    std::vector<LICThreadStats> threads_;
+    std::atomic<bool> aborted_;
+    std::chrono::steady_clock::time_point abortTime_;
+};
+
+// The LIC_STATS_FILE the renders append to
+class StatsLog {
+public:
+    // nullptr unless LIC_STATS_FILE is set
+    static StatsLog *instance();
+
+    void write(const std::string &line);
+
+private:
+    explicit StatsLog(std::string path) : path_(std::move(path)) {}
+
+    std::string path_;
+    std::mutex mutex_;
+};
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Weight of step signedIdx (-num_steps to +num_steps) of the streamline
+static inline float step_weight(int signedIdx, int num_steps, bool use_weight_window,
+                                int weight_window_width, int weight_window_offset) {
+    if (!use_weight_window) {
+        return 1.0f;
+    } else {
+        int N = 2*num_steps;
+        int idx = (signedIdx + num_steps) % (N + 1);
+        int offsetIdx = (weight_window_offset + num_steps) % N;
+        int offsetIdx2 = ((weight_window_offset + num_steps) % N) + N;
+        int dist = std::min(std::abs(idx - offsetIdx), std::abs(idx - offsetIdx2));
+
+        if (dist > weight_window_width) {
+            return 0.0f;
+        } else {
+            return 1.0f - (float)dist/(float)weight_window_width;
+        }
+    }
+}
+
+// Fills table with weights of steps -num_steps to +num_steps and returns their sum
+static inline float build_step_weights(std::vector<float> &table, int num_steps, bool use_weight_window,
+                                       int weight_window_width, int weight_window_offset) {
+    table.resize(2 * num_steps + 1);
+    float *weights = table.data() + num_steps;
+
+    // sum them up in the same order as the integrators do
+    weights[0] = step_weight(0, num_steps, use_weight_window, weight_window_width, weight_window_offset);
+    float weightSum = weights[0];
+    for (int i = 1; i <= num_steps; i++) {
+        weights[i] = step_weight(i, num_steps, use_weight_window, weight_window_width, weight_window_offset);
+        weightSum += weights[i];
+    }
+    for (int i = 1; i <= num_steps; i++) {
+        weights[-i] = step_weight(-i, num_steps, use_weight_window, weight_window_width, weight_window_offset);
+        weightSum += weights[-i];
+    }
+    return weightSum;
+}
+
+// Number of steps worth integrating in one direction (sign = +1 forward, -1 backward) of a table built by
+// build_step_weights() - the streamline can stop after the last non-zero weight, steps past it add nothing
+static inline int weighted_steps(const std::vector<float> &table, int num_steps, int sign) {
+    const float *weights = table.data() + num_steps;
+    int n = num_steps;
+    while (n > 0 && weights[sign * n] == 0.0f) {
+        n--;
+    }
+    return n;
+}
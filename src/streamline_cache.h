@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ofxsMultiThread.h"
+#include "rect.h"
+
+// Identifies the streamlines of a render - same direction field, noise, step count and vector lookup mean same noise samples
+// along the streamlines, whatever the weights
+struct StreamlineCacheKey {
+    uint64_t fieldHash;
+    RectI window;
+    float frequency;
+    int noiseType;
+    uint32_t seed;
+    bool bakedNoise;
+    int numSteps;
+    bool bilinearVectors;
+
+    bool operator==(const StreamlineCacheKey &o) const {
+        return fieldHash == o.fieldHash && window.x1 == o.window.x1 && window.y1 == o.window.y1 &&
+               window.x2 == o.window.x2 && window.y2 == o.window.y2 && frequency == o.frequency &&
+               noiseType == o.noiseType && seed == o.seed && bakedNoise == o.bakedNoise && numSteps == o.numSteps && bilinearVectors == o.bilinearVectors;
+    }
+};
+
+// Noise samples along the streamline of each pixel of the window (2 * numSteps + 1 per pixel), and whether
+// the pixel has a streamline at all. Filled by one render, read-only afterwards. The buffers are not initialized,
+// the render sets valid for every pixel and the samples of the valid ones.
+class StreamlineCache {
+public:
+    // caches bigger than this are not kept, eg. 4K at 15 steps is ~1 GB
+    static const size_t kMaxBytes = size_t(1) << 30;
+
+    explicit StreamlineCache(const StreamlineCacheKey &key)
+            : key_(key), samplesPerPixel_(2 * key.numSteps + 1),
+              samples_(new float[(size_t) key.window.width() * key.window.height() * samplesPerPixel_]),
+              valid_(new uint8_t[(size_t) key.window.width() * key.window.height()]) {}
+
+    static size_t bytesFor(const RectI &window, int numSteps) {
+        return (size_t) window.width() * window.height() * (sizeof(float) * (2 * numSteps + 1) + 1);
+    }
+
+    const StreamlineCacheKey &key() const { return key_; }
+
+    size_t bytes() const { return bytesFor(key_.window, key_.numSteps); }
+
+    // samples of pixel (x, y) indexed by signed step -numSteps to +numSteps, ie. points to the middle
+    inline float *samples(int x, int y) {
+        return &samples_[pixelIndex(x, y) * samplesPerPixel_ + key_.numSteps];
+    }
+
+    inline const float *samples(int x, int y) const {
+        return &samples_[pixelIndex(x, y) * samplesPerPixel_ + key_.numSteps];
+    }
+
+    inline uint8_t &valid(int x, int y) { return valid_[pixelIndex(x, y)]; }
+
+    inline bool valid(int x, int y) const { return valid_[pixelIndex(x, y)] != 0; }
+
+private:
+    StreamlineCacheKey key_;
+    size_t samplesPerPixel_;
+    std::unique_ptr<float[]> samples_;
+    std::unique_ptr<uint8_t[]> valid_;
+
+    inline size_t pixelIndex(int x, int y) const {
+        return (size_t) (y - key_.window.y1) * key_.window.width() + (x - key_.window.x1);
+    }
+};
+
+// Streamline caches of the last renders, one per window (hosts render frames in tiles, from several threads),
+// the oldest ones are dropped to stay within kMaxBytes in total. Lookups take a snapshot of the set with
+// std::atomic_load and don't lock; a published set is never modified, insert() copies it and swaps the copy in.
+class StreamlineCacheSet {
+public:
+    std::shared_ptr<const StreamlineCache> find(const StreamlineCacheKey &key) const {
+        std::shared_ptr<const Caches> caches = std::atomic_load(&caches_);
+        if (caches) {
+            for (const auto &cache: *caches) {
+                if (cache->key() == key) return cache;
+            }
+        }
+        return nullptr;
+    }
+
+    // replaces the one with the same window, if any
+    void insert(const std::shared_ptr<const StreamlineCache> &cache) {
+        OFX::MultiThread::AutoMutex lock(insertMutex_);
+        std::shared_ptr<const Caches> caches = std::atomic_load(&caches_);
+        const RectI &window = cache->key().window;
+
+        auto updated = std::make_shared<Caches>();
+        updated->push_back(cache);
+        size_t bytes = cache->bytes();
+        if (caches) {
+            for (const auto &kept: *caches) {
+                const RectI &w = kept->key().window;
+                if (w.x1 == window.x1 && w.y1 == window.y1 && w.x2 == window.x2 && w.y2 == window.y2) continue;
+                if (bytes + kept->bytes() > StreamlineCache::kMaxBytes) break;
+                updated->push_back(kept);
+                bytes += kept->bytes();
+            }
+        }
+        std::atomic_store(&caches_, std::shared_ptr<const Caches>(updated));
+    }
+
+    // renders in progress keep their own snapshot
+    void clear() {
+        OFX::MultiThread::AutoMutex lock(insertMutex_);
+        std::atomic_store(&caches_, std::shared_ptr<const Caches>());
+    }
+
+private:
+    // most recently inserted first
+    typedef std::vector<std::shared_ptr<const StreamlineCache>> Caches;
+
+    std::shared_ptr<const Caches> caches_;
+    OFX::MultiThread::Mutex insertMutex_;
+};
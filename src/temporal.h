@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "buffer_arena.h"
+#include "rect.h"
+#include "texture_field.h"
+
+// Temporal LIC - each frame is blended with the previous one, moved along the motion vectors. Repeated every
+// frame, this keeps the pattern coherent in time and lengthens the streaks along the flow without longer
+// streamlines (as in Lagrangian-Eulerian advection), so that shorter kernels do for the same look.
+
+// Screen space motion over a region: the raw vectors (not normalized) in pixels per frame at the render scale,
+// zero where they are NaN. Lookups outside of the bounds get the clamped edge value.
+class MotionField {
+public:
+    MotionField() : bounds_{0, 0, 0, 0}, scale_(1.0f) {}
+
+    // contents are undefined until the rows are filled and scaled; scale converts the vectors
+    // to pixels per frame
+    void reset(const RectI &bounds, float scale, BufferArena *arena = nullptr) {
+        bounds_ = bounds;
+        scale_ = scale;
+        data_ = ArenaBuffer();
+        data_ = BufferArena::acquire(arena, 2 * (size_t) bounds.width() * (size_t) bounds.height() * sizeof(float));
+    }
+
+    const RectI &bounds() const { return bounds_; }
+
+    float *row(int y) {
+        return data_.data<float>() + 2 * (size_t) (y - bounds_.y1) * (size_t) bounds_.width();
+    }
+
+    // call on the raw vectors put into row()
+    void scaleRow(int y) {
+        float *v = row(y);
+        for (int i = 0; i < 2 * bounds_.width(); i++) {
+            v[i] = std::isfinite(v[i]) ? v[i] * scale_ : 0.0f;
+        }
+    }
+
+    // motion of the nearest pixel
+    inline void at(float x, float y, float &vx, float &vy) const {
+        int ix = std::min(std::max((int) std::floor(x + 0.5f), bounds_.x1), bounds_.x2 - 1);
+        int iy = std::min(std::max((int) std::floor(y + 0.5f), bounds_.y1), bounds_.y2 - 1);
+        const float *v = data_.data<const float>() +
+                         2 * ((size_t) (iy - bounds_.y1) * (size_t) bounds_.width() + (size_t) (ix - bounds_.x1));
+        vx = v[0];
+        vy = v[1];
+    }
+
+private:
+    RectI bounds_;
+    float scale_;
+    ArenaBuffer data_;
+};
+
+// Where the content of pixel (x, y) was on the previous frame: back along this frame's motion, then again
+// with the average of that and the previous frame's motion at the first estimate (midpoint rule, so that
+// curved and accelerating flow moves the pattern along, not across). previous can be nullptr.
+inline void temporal_backtrace(const MotionField &current, const MotionField *previous, int x, int y,
+                               float &px, float &py) {
+    float vx, vy;
+    current.at((float) x, (float) y, vx, vy);
+    px = (float) x - vx;
+    py = (float) y - vy;
+    if (previous) {
+        float wx, wy;
+        previous->at(px, py, wx, wy);
+        px = (float) x - 0.5f * (vx + wx);
+        py = (float) y - 0.5f * (vy + wy);
+    }
+}
+
+// Blends the current pixel (premultiplied RGBA, coverage in alpha) with the previous frame at (px, py), keeping
+// amount of the latter. Coverage stays that of the current frame - masks don't smear - and the previous colour
+// is rescaled to it. Pixels without coverage in either, or with (px, py) off the previous frame, stay as they are.
+inline void temporal_blend(float *rgba, const TextureField &previous, float px, float py, float amount) {
+    const RectI &b = previous.bounds();
+    if (rgba[3] == 0.0f || !(px >= (float) b.x1 && px < (float) (b.x2 - 1) &&
+                             py >= (float) b.y1 && py < (float) (b.y2 - 1))) {
+        return;
+    }
+
+    float h[4];
+    previous.sample(px, py, h);
+    if (h[3] <= 0.0f) return;
+
+    float rescale = rgba[3] / h[3];
+    for (int c = 0; c < 3; c++) {
+        rgba[c] += amount * (h[c] * rescale - rgba[c]);
+    }
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "buffer_arena.h"
+#include "rect.h"
+
+// Premultiplied RGBA texture for colour LIC, packed into one float buffer with the same bounds as
+// the DirectionField (render window plus everything the streamlines reach), so lookups along the streamlines
+// need no clamping. Pixels in the border which are outside of the source image hold the clamped edge values.
+class TextureField {
+public:
+    TextureField() : bounds_{0, 0, 0, 0} {}
+
+    // contents are undefined until the rows are filled
+    void reset(const RectI &bounds, BufferArena *arena = nullptr) {
+        bounds_ = bounds;
+        data_ = ArenaBuffer();
+        data_ = BufferArena::acquire(arena, 4 * (size_t) bounds.width() * (size_t) bounds.height() * sizeof(float));
+    }
+
+    const RectI &bounds() const { return bounds_; }
+
+    float *row(int y) {
+        return data_.data<float>() + 4 * (size_t) (y - bounds_.y1) * (size_t) bounds_.width();
+    }
+
+    // (x, y) must be inside bounds()
+    inline const float *at(int x, int y) const {
+        return data_.data<const float>() +
+               4 * ((size_t) (y - bounds_.y1) * (size_t) bounds_.width() + (size_t) (x - bounds_.x1));
+    }
+
+    // Bilinearly interpolated RGBA at (x, y) - (x, y) and (x + 1, y + 1) must be inside bounds()
+    inline void sample(float x, float y, float *rgba) const {
+        float fx = std::floor(x), fy = std::floor(y);
+        float ax = x - fx, ay = y - fy;
+        const float *t = at((int) fx, (int) fy);
+        const size_t stride = 4 * (size_t) bounds_.width();
+        for (int c = 0; c < 4; c++) {
+            float top = t[c] + ax * (t[4 + c] - t[c]);
+            float bottom = t[stride + c] + ax * (t[stride + 4 + c] - t[stride + c]);
+            rgba[c] = top + ay * (bottom - top);
+        }
+    }
+
+    // Hash of the bounds and texels, to recognize the same texture in a later render
+    uint64_t hash() const {
+        // FNV-1a over 64-bit words, as DirectionField::hash()
+        const uint64_t prime = 0x100000001b3ULL;
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (int v: {bounds_.x1, bounds_.y1, bounds_.x2, bounds_.y2}) {
+            h = (h ^ (uint32_t) v) * prime;
+        }
+        const float *data = data_.data<const float>();
+        size_t size = 4 * (size_t) bounds_.width() * (size_t) bounds_.height();
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            uint64_t w;
+            std::memcpy(&w, &data[i], sizeof(w));
+            h = (h ^ w) * prime;
+        }
+        return h;
+    }
+
+private:
+    RectI bounds_;
+    ArenaBuffer data_;
+};
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2022 Tomas Karabela
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "rect.h"
+
+// Splits a window into square tiles and hands them out to worker threads.
+//
+// Each thread starts with its own contiguous range of tiles (neighbouring tiles share most of the vector field
+// they read), taking them from the front. When it runs out, it steals tiles from the back of other threads' ranges,
+// so that threads which got cheap (eg. masked) tiles help out with the expensive ones instead of idling.
+//
+// Call reset() before the threads start, then next() from each of them.
+class TileScheduler {
+public:
+    TileScheduler() : window_{0, 0, 0, 0}, tileSize_(1), tilesX_(0), numRanges_(0) {}
+
+    void reset(const RectI &window, int tileSize, unsigned int numThreads) {
+        window_ = window;
+        tileSize_ = tileSize;
+        tilesX_ = (window.width() + tileSize - 1) / tileSize;
+        int tilesY = (window.height() + tileSize - 1) / tileSize;
+        int numTiles = window.isEmpty() ? 0 : tilesX_ * tilesY;
+
+        numRanges_ = numThreads > 0 ? numThreads : 1;
+        ranges_.reset(new Range[numRanges_]);
+        for (unsigned int i = 0; i < numRanges_; i++) {
+            auto begin = (uint32_t) ((uint64_t) numTiles * i / numRanges_);
+            auto end = (uint32_t) ((uint64_t) numTiles * (i + 1) / numRanges_);
+            ranges_[i].bounds.store(pack(begin, end), std::memory_order_relaxed);
+        }
+    }
+
+    // Gets the next tile for the thread, returns false when all work is taken.
+    // Threads with index >= numThreads passed to reset() only steal.
+    bool next(unsigned int threadIndex, RectI &tile) {
+        int idx;
+        if (threadIndex < numRanges_ && takeFront(ranges_[threadIndex], idx)) {
+            tile = tileRect(idx);
+            return true;
+        }
+
+        for (unsigned int i = 1; i <= numRanges_; i++) {
+            if (takeBack(ranges_[(threadIndex + i) % numRanges_], idx)) {
+                tile = tileRect(idx);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // [begin, end) of the tiles yet to be processed, packed into one word so that the owner and thieves can
+    // update it with a single compare-and-swap; padded so that ranges of different threads don't share cache lines
+    struct Range {
+        std::atomic<uint64_t> bounds;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    RectI window_;
+    int tileSize_;
+    int tilesX_;
+    unsigned int numRanges_;
+    std::unique_ptr<Range[]> ranges_;
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return ((uint64_t) begin << 32) | end; }
+
+    static bool takeFront(Range &range, int &idx) {
+        uint64_t bounds = range.bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            auto begin = (uint32_t) (bounds >> 32), end = (uint32_t) bounds;
+            if (begin >= end) return false;
+            if (range.bounds.compare_exchange_weak(bounds, pack(begin + 1, end), std::memory_order_relaxed)) {
+                idx = (int) begin;
+                return true;
+            }
+        }
+    }
+
+    static bool takeBack(Range &range, int &idx) {
+        uint64_t bounds = range.bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            auto begin = (uint32_t) (bounds >> 32), end = (uint32_t) bounds;
+            if (begin >= end) return false;
+            if (range.bounds.compare_exchange_weak(bounds, pack(begin, end - 1), std::memory_order_relaxed)) {
+                idx = (int) end - 1;
+                return true;
+            }
+        }
+    }
+
+    RectI tileRect(int idx) const {
+        int x1 = window_.x1 + (idx % tilesX_) * tileSize_;
+        int y1 = window_.y1 + (idx / tilesX_) * tileSize_;
+        return {x1, y1, std::min(x1 + tileSize_, window_.x2), std::min(y1 + tileSize_, window_.y2)};
+    }
+};